@@ -0,0 +1,14 @@
+#!/bin/sh
+# Copyright (c) 2013, Jeremy Pinat.
+#
+# Print a Shirka file made of one big list literal (numbers, quoted symbols,
+# strings and nested lists) of SIZE lines, which is then dropped.
+#
+# Usage: bench/gen-parse.sh [SIZE]
+
+awk -v n="${1:-100000}" 'BEGIN {
+	print "["
+	for (i = 0; i < n; i++)
+		printf "%d %d.5 :sym%d \"string %d\" [a [b c]] -- comment\n", i, i, i % 100, i
+	print "] length? << <<"
+}'
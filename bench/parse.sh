@@ -0,0 +1,26 @@
+#!/bin/sh
+# Copyright (c) 2013, Jeremy Pinat.
+#
+# Parse throughput benchmark.
+#
+# Generate a data file made of one big list literal (numbers, quoted symbols,
+# strings and nested lists), then time how long the interpreter takes to load
+# it. Doubling SIZE should roughly double the time.
+#
+# Usage: bench/parse.sh [SIZE] [SHIRKA]
+
+SIZE=${1:-100000}
+SHIRKA=${2:-./shirka}
+DATA=${TMPDIR:-/tmp}/shirka-parse-$$.shk
+
+trap 'rm -f "$DATA"' EXIT INT TERM
+
+sh "$(dirname "$0")/gen-parse.sh" "$SIZE" > "$DATA"
+
+BYTES=$(wc -c < "$DATA")
+START=$(date +%s%N)
+"$SHIRKA" "$DATA" || exit 1
+END=$(date +%s%N)
+
+MS=$(( (END - START) / 1000000 ))
+echo "parse size=$SIZE bytes=$BYTES ms=$MS"
@@ -0,0 +1,66 @@
+#!/bin/sh
+# Copyright (c) 2013, Jeremy Pinat.
+#
+# Benchmark suite.
+#
+# Run each workload of the bench directory, and a parsing workload generated
+# by gen-parse.sh, RUNS times. Print one line per workload:
+#
+#   bench=NAME runs=N ms_min=.. ms_median=.. ms_max=.. instructions=.. peak_rss=..
+#
+# Times are wall clock times. `instructions' is the number of instructions
+# executed by the interpreter (see `--stats'), which does not depend on the
+# machine. `peak_rss' is the highest peak resident set size of the runs, as
+# reported by the interpreter (kilobytes on Linux). A workload that fails is
+# reported as `bench=NAME error=STATUS'.
+#
+# Run from the root of the repository, so that workloads find their modules.
+#
+# Usage: bench/run.sh [RUNS] [SHIRKA]
+
+RUNS=${1:-5}
+SHIRKA=${2:-./shirka}
+TMP=${TMPDIR:-/tmp}/shirka-bench-$$
+BENCH=$(dirname "$0")
+
+trap 'rm -rf "$TMP"' EXIT INT TERM
+mkdir -p "$TMP"
+
+sh "$BENCH/gen-parse.sh" 200000 > "$TMP/parse.shk"
+
+for FILE in "$BENCH"/*.shk "$TMP/parse.shk"; do
+	NAME=$(basename "$FILE" .shk)
+	STATUS=0
+	: > "$TMP/times"
+
+	i=0
+	while [ $i -lt "$RUNS" ]; do
+		START=$(date +%s%N)
+		"$SHIRKA" --stats "$FILE" > /dev/null 2> "$TMP/stats" || STATUS=$?
+		END=$(date +%s%N)
+		[ $STATUS -ne 0 ] && break
+
+		echo $(( (END - START) / 1000000 )) >> "$TMP/times"
+		awk '$1 == "exec/instructions" { print $2 }' "$TMP/stats" \
+			> "$TMP/instructions"
+		awk '$1 == "process/peak-rss" { print $2 }' "$TMP/stats" \
+			>> "$TMP/rss"
+		i=$((i + 1))
+	done
+
+	if [ $STATUS -ne 0 ]; then
+		echo "bench=$NAME error=$STATUS"
+		continue
+	fi
+
+	sort -n "$TMP/times" | awk -v name="$NAME" -v runs="$RUNS" \
+		-v instructions="$(cat "$TMP/instructions")" \
+		-v rss="$(sort -n "$TMP/rss" | tail -n 1)" '
+		{ t[NR] = $1 }
+		END {
+			printf "bench=%s runs=%d ms_min=%d ms_median=%d ms_max=%d",
+				name, runs, t[1], t[int((NR + 1) / 2)], t[NR]
+			printf " instructions=%s peak_rss=%s\n", instructions, rss
+		}'
+	rm -f "$TMP/rss"
+done
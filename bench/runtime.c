@@ -0,0 +1,332 @@
+/* Copyright (c) 2013, Jeremy Pinat. */
+
+/*
+Runtime microbenchmarks
+=======================
+
+Time the primitives of the runtime that programs lean on the most, calling
+them directly rather than through Shirka programs:
+
+- `skO_clone' and `skO_free' on wide and deep lists;
+- `skO_eql' and `skO_hash' on the same lists;
+- `scope_find' at various scope depths and numbers of definitions;
+- `symbol_id_from_string' with few and many symbols;
+- `skO_parse' on a large input;
+- `skE_stackPush' and `skE_stackPop', for objects and for values.
+
+Each benchmark prints one line of `key=value' pairs, like `bench/run.sh':
+
+    bench=NAME ops=N ns_op=.. allocs_op=..
+
+where `allocs_op' counts the blocks taken from the memory pools per
+operation. Build and run with `make bench-runtime'.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../shirka.h"
+
+/* Not part of the public interface. */
+reserved *scope_find          (skE *env, skO *sym);
+void     reserve_object       (skE *env, symbol *sym, skO *obj);
+symbol   *symbol_id_from_string (char *str);
+
+typedef struct {
+	double        start;
+	unsigned long allocs;
+} measure;
+
+double now (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void measure_start (measure *m)
+{
+	m->allocs = skM_counters.allocs;
+	m->start  = now();
+}
+
+void measure_stop (measure *m, const char *name, unsigned long ops)
+{
+	double        elapsed = now() - m->start;
+	unsigned long allocs  = skM_counters.allocs - m->allocs;
+
+	printf("bench=%s ops=%lu ns_op=%.1f allocs_op=%.2f\n", name, ops,
+		elapsed / ops, (double)allocs / ops);
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                  CLONING                                 //
+////////////////////////////////////////////////////////////////////////////*/
+
+skO *wide_list (size_t width)
+{
+	skO    *list = skO_list_new();
+	size_t i;
+
+	for (i = 0; i < width; i++)
+		sk_list_append(list, skO_integer_new(i));
+
+	return list;
+}
+
+skO *deep_list (size_t depth)
+{
+	skO    *list = skO_list_new();
+	skO    *outer;
+	size_t i;
+
+	for (i = 0; i < depth; i++) {
+		outer = skO_list_new();
+		sk_list_append(outer, skO_integer_new(i));
+		sk_list_append(outer, list);
+		list = outer;
+	}
+
+	return list;
+}
+
+void bench_clone (const char *name, skO *list, unsigned long ops)
+{
+	measure       m;
+	unsigned long i;
+
+	measure_start(&m);
+	for (i = 0; i < ops; i++)
+		skO_free(skO_clone(list));
+	measure_stop(&m, name, ops);
+
+	skO_free(list);
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                 EQUALITY                                 //
+////////////////////////////////////////////////////////////////////////////*/
+
+/*
+Compare `list' with a copy of itself and with a list one element longer,
+then hash it.
+*/
+void bench_eql (const char *name, skO *list, unsigned long ops)
+{
+	skO           *copy   = skO_clone(list);
+	skO           *longer = skO_clone(list);
+	char          label[64];
+	measure       m;
+	unsigned long n;
+
+	sk_list_append(longer, skO_integer_new(0));
+
+	snprintf(label, sizeof(label), "eql/same-%s", name);
+	measure_start(&m);
+	for (n = 0; n < ops; n++) {
+		if (!skO_eql(list, copy))
+			FATAL("skO_eql failed\n");
+	}
+	measure_stop(&m, label, ops);
+
+	snprintf(label, sizeof(label), "eql/longer-%s", name);
+	measure_start(&m);
+	for (n = 0; n < ops; n++) {
+		if (skO_eql(list, longer))
+			FATAL("skO_eql failed\n");
+	}
+	measure_stop(&m, label, ops);
+
+	snprintf(label, sizeof(label), "hash/%s", name);
+	measure_start(&m);
+	for (n = 0; n < ops; n++) {
+		if (skO_hash(list) != skO_hash(copy))
+			FATAL("skO_hash failed\n");
+	}
+	measure_stop(&m, label, ops * 2);
+
+	skO_free(list);
+	skO_free(copy);
+	skO_free(longer);
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                  SCOPES                                  //
+////////////////////////////////////////////////////////////////////////////*/
+
+/*
+Look up a symbol defined in the outermost of `depth' scopes, each holding
+`defs' other definitions.
+*/
+void bench_scope_find (size_t depth, size_t defs, unsigned long ops)
+{
+	skE           *env    = skE_new();
+	skO           *target = skO_symbol_new("bench/target");
+	char          name[64];
+	char          label[64];
+	measure       m;
+	size_t        i;
+	size_t        j;
+	unsigned long n;
+
+	for (i = 0; i < depth; i++) {
+		skE_scopePush(env);
+		if (i == 0)
+			reserve_object(env, target->data.sym, skO_integer_new(0));
+		for (j = 0; j < defs; j++) {
+			snprintf(name, sizeof(name), "bench/def-%lu",
+				(unsigned long)j);
+			reserve_object(env, symbol_id_from_string(name),
+				skO_integer_new(j));
+		}
+	}
+
+	snprintf(label, sizeof(label), "scope_find/depth-%lu-defs-%lu",
+		(unsigned long)depth, (unsigned long)defs);
+
+	measure_start(&m);
+	for (n = 0; n < ops; n++) {
+		if (!scope_find(env, target))
+			FATAL("scope_find failed\n");
+	}
+	measure_stop(&m, label, ops);
+
+	while (env->scope->parent)
+		skE_scopePop(env);
+	skE_free(env);
+	skO_free(target);
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                 SYMBOLS                                  //
+////////////////////////////////////////////////////////////////////////////*/
+
+/*
+Intern `count' symbols, then look them up again.
+*/
+void bench_symbols (size_t count, unsigned long ops)
+{
+	char          (*names)[64] = malloc(count * sizeof(*names));
+	char          label[64];
+	measure       m;
+	size_t        i;
+	unsigned long n;
+
+	for (i = 0; i < count; i++) {
+		snprintf(names[i], sizeof(names[i]), "bench/symbol-%lu-%lu",
+			(unsigned long)count, (unsigned long)i);
+	}
+
+	snprintf(label, sizeof(label), "symbol_id_from_string/new-%lu",
+		(unsigned long)count);
+	measure_start(&m);
+	for (i = 0; i < count; i++)
+		symbol_id_from_string(names[i]);
+	measure_stop(&m, label, count);
+
+	snprintf(label, sizeof(label), "symbol_id_from_string/existing-%lu",
+		(unsigned long)count);
+	measure_start(&m);
+	for (n = 0; n < ops; n++)
+		symbol_id_from_string(names[n % count]);
+	measure_stop(&m, label, ops);
+
+	free(names);
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                 PARSING                                  //
+////////////////////////////////////////////////////////////////////////////*/
+
+void bench_parse (size_t lines, unsigned long ops)
+{
+	char          *source = malloc(lines * 64 + 1);
+	char          *cursor = source;
+	char          label[64];
+	jmp_buf       jmp;
+	measure       m;
+	size_t        i;
+	unsigned long n;
+
+	for (i = 0; i < lines; i++) {
+		cursor += sprintf(cursor, "%lu %lu.5 :sym%lu \"string\" [a [b c]]\n",
+			(unsigned long)i, (unsigned long)i, (unsigned long)i % 100);
+	}
+
+	if (setjmp(jmp))
+		FATAL("skO_parse failed\n");
+
+	snprintf(label, sizeof(label), "skO_parse/lines-%lu",
+		(unsigned long)lines);
+	measure_start(&m);
+	for (n = 0; n < ops; n++) {
+		cursor = source;
+		skO_free(skO_parse(&cursor, jmp, NULL));
+	}
+	measure_stop(&m, label, ops);
+
+	free(source);
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                  STACK                                   //
+////////////////////////////////////////////////////////////////////////////*/
+
+void bench_stack (unsigned long ops)
+{
+	skE           *env = skE_new();
+	skV           v;
+	measure       m;
+	unsigned long n;
+
+	v.tag          = SKO_INTEGER;
+	v.data.integer = 1;
+
+	measure_start(&m);
+	for (n = 0; n < ops; n++) {
+		skE_stackPush(env, skO_integer_new(n));
+		skO_free(skE_stackPop(env));
+	}
+	measure_stop(&m, "stack/push-pop-object", ops);
+
+	measure_start(&m);
+	for (n = 0; n < ops; n++) {
+		skE_stackPushValue(env, v);
+		v = skE_stackPopValue(env);
+	}
+	measure_stop(&m, "stack/push-pop-value", ops);
+
+	skE_scopePush(env);
+	skE_free(env);
+}
+
+int main (void)
+{
+	bench_clone("clone/wide-10", wide_list(10), 1000000);
+	bench_clone("clone/wide-1000", wide_list(1000), 10000);
+	bench_clone("clone/deep-10", deep_list(10), 500000);
+	bench_clone("clone/deep-1000", deep_list(1000), 5000);
+
+	bench_eql("wide-1000", wide_list(1000), 10000);
+	bench_eql("deep-1000", deep_list(1000), 10000);
+
+	bench_scope_find(1, 1, 10000000);
+	bench_scope_find(1, 64, 1000000);
+	bench_scope_find(16, 1, 1000000);
+	bench_scope_find(16, 16, 100000);
+	bench_scope_find(64, 16, 100000);
+
+	bench_symbols(1000, 10000000);
+	bench_symbols(100000, 10000000);
+
+	bench_parse(10000, 20);
+
+	bench_stack(10000000);
+
+	return 0;
+}
@@ -0,0 +1,599 @@
+/* Copyright (c) 2013, Jeremy Pinat. */
+
+/*
+Compiler
+========
+
+Operation bodies are compiled once, when they are defined, into a flat
+array of instructions which is then run by the executor in `env.c'. This
+avoids walking the list of tokens and switching on their tags at each call.
+
+The translation is straightforward:
+
+- literals become `SKC_PUSH' instructions (a copy of the literal is pushed
+  when the instruction runs);
+- symbols become `SKC_CALL' instructions, or `SKC_TAIL' when they are the
+  last token of the body;
+- the "reserving operations" sugar (`:name $->', `:name $<-' and
+  `:name $=>') is fused into single `SKC_RESERVE', `SKC_RESTORE' and
+  `SKC_DEFINE' instructions.
+
+Shirka is dynamically scoped, so symbols cannot be resolved at compile time:
+a `SKC_CALL' still looks its symbol up when it runs. The result is kept in
+the instruction itself (an "inline cache") along with the version of the
+symbol; it stays valid until a definition of that symbol is added or
+removed, which bumps the version. Fused reserving instructions only assume
+the intrinsic reserving operations are not shadowed, which is checked at
+run time (see `symbol.defs').
+
+Objects reserved with `SKC_RESERVE' are given a slot in the frame of the
+operation: each distinct name gets an index when the body is compiled, and
+the context of each call is allocated with room for all of them. Reserving
+and restoring then index the frame instead of searching the context.
+
+Instructions keep pointers to the tokens of the body, which must therefore
+outlive the compiled code.
+
+------------------------------------------------------------------------------
+
+Once translated, the body goes through a peephole pass which replaces
+common idioms of the prelude with superinstructions:
+
+- `-> x x <- x' (dup) becomes `SKC_DUP';
+- `-> x -> y <- x <- y' (swap) becomes `SKC_SWAP';
+- `-> x' at the end of a body (drop) becomes `SKC_DROP';
+- an integer literal followed by a call to `+', `-', `*', `=', `<' or `>'
+  (as in `1 -' or `length? 0 =') becomes `SKC_OPERAND';
+- `not [...] !?' (written `not (!?) [...]') becomes `SKC_UNLESS'.
+
+A superinstruction replaces the first instruction of its sequence, and the
+others are left in place after it. When it runs, it checks that the
+intrinsics it stands for are not shadowed and that its operands have the
+expected types; if so it performs the whole sequence at once and skips the
+rest of it, otherwise it performs the first instruction only and execution
+continues normally. The behaviour of the code is therefore the same as
+without the pass.
+
+Operations whose whole body is a dup, swap or drop (`>>', `><' and `<<' in
+the prelude) are marked with that idiom, so that their callers can perform
+it directly instead of entering a new frame.
+
+------------------------------------------------------------------------------
+
+Before the peephole pass, calls to pure intrinsics (arithmetic,
+comparisons, boolean operations, `cons') whose operands are literals are
+folded: `0.5 2 ^' or `[] 1 cons 2 cons' are computed when the operation is
+defined, with the intrinsics it resolves to at that time, and replaced with
+an `SKC_CONST' instruction pushing the result. Only operands whose types are
+accepted by the intrinsic are folded, so that errors still happen when the
+code runs.
+
+------------------------------------------------------------------------------
+
+To print each compiled body on the standard error stream, define the
+constant `SK_COMPILER_DEBUG' when compiling the interpreter.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "shirka.h"
+
+symbol *sk_sym_reserve   = NULL;
+symbol *sk_sym_restore   = NULL;
+symbol *sk_sym_define    = NULL;
+
+/* Intrinsics fused by the peephole pass. */
+symbol *operand_syms[6];
+symbol *sym_not          = NULL;
+symbol *sym_exec_if      = NULL;
+
+typedef enum {
+	FOLD_NONE,     /* no operand                             */
+	FOLD_NUMBERS,  /* numbers only                           */
+	FOLD_BOOLEANS, /* booleans only                          */
+	FOLD_ANY,      /* any literal                            */
+	FOLD_CONS      /* a list, then any literal               */
+} fold_operands;
+
+typedef struct {
+	char          *name;
+	size_t        arity;
+	fold_operands operands;
+} pure_intrinsic;
+
+/*
+Intrinsics without side effects, each pushing a single object. As long as
+their operands have the listed types, they cannot fail.
+*/
+pure_intrinsic pure_intrinsics[] = {
+	{ "+",     2, FOLD_NUMBERS  },
+	{ "-",     2, FOLD_NUMBERS  },
+	{ "*",     2, FOLD_NUMBERS  },
+	{ "/",     2, FOLD_NUMBERS  },
+	{ "^",     2, FOLD_NUMBERS  },
+	{ "%",     2, FOLD_NUMBERS  },
+	{ "abs",   1, FOLD_NUMBERS  },
+	{ "<",     2, FOLD_NUMBERS  },
+	{ ">",     2, FOLD_NUMBERS  },
+	{ "=",     2, FOLD_ANY      },
+	{ "and",   2, FOLD_BOOLEANS },
+	{ "or",    2, FOLD_BOOLEANS },
+	{ "not",   1, FOLD_BOOLEANS },
+	{ "TRUE",  0, FOLD_NONE     },
+	{ "FALSE", 0, FOLD_NONE     },
+	{ "cons",  2, FOLD_CONS     }
+};
+
+#define PURE_INTRINSICS (sizeof(pure_intrinsics) / sizeof(pure_intrinsic))
+
+symbol *pure_syms[PURE_INTRINSICS];
+
+void skC_init (void)
+{
+	size_t i;
+
+	if (sk_sym_reserve)
+		return;
+
+	sk_sym_reserve = sk_symbol_intern("$->", 3);
+	sk_sym_restore = sk_symbol_intern("$<-", 3);
+	sk_sym_define  = sk_symbol_intern("$=>", 3);
+
+	operand_syms[0] = sk_symbol_intern("+", 1);
+	operand_syms[1] = sk_symbol_intern("-", 1);
+	operand_syms[2] = sk_symbol_intern("*", 1);
+	operand_syms[3] = sk_symbol_intern("=", 1);
+	operand_syms[4] = sk_symbol_intern("<", 1);
+	operand_syms[5] = sk_symbol_intern(">", 1);
+
+	sym_not     = sk_symbol_intern("not", 3);
+	sym_exec_if = sk_symbol_intern("!?", 2);
+
+	for (i = 0; i < PURE_INTRINSICS; i++) {
+		pure_syms[i] = sk_symbol_intern(pure_intrinsics[i].name,
+			strlen(pure_intrinsics[i].name));
+	}
+}
+
+/*
+Return the fused instruction corresponding to a reserving intrinsic, or
+`SKC_END' if `sym' is not one of them.
+*/
+skC_op reserving_op (symbol *sym)
+{
+	if (sym == sk_sym_reserve)
+		return SKC_RESERVE;
+	if (sym == sk_sym_restore)
+		return SKC_RESTORE;
+	if (sym == sk_sym_define)
+		return SKC_DEFINE;
+
+	return SKC_END;
+}
+
+/*
+Return the frame slot of `sym', allocating a new one if needed.
+*/
+size_t local_slot (skC_code *code, symbol *sym)
+{
+	size_t i;
+
+	for (i = 0; i < code->nslots; i++) {
+		if (code->locals[i] == sym)
+			return i;
+	}
+
+	code->locals[code->nslots] = sym;
+	return code->nslots++;
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                             CONSTANT FOLDING                             //
+////////////////////////////////////////////////////////////////////////////*/
+
+/*
+Objects computed so far by the folded code: either a literal pushed by the
+instruction at `start', or the result of the instructions from `start' to
+the next entry (`value').
+*/
+typedef struct {
+	skO    *value;
+	size_t start;
+} fold_entry;
+
+skO *fold_operand (skC_code *code, fold_entry *e)
+{
+	return e->value ? e->value : code->ins[e->start].obj;
+}
+
+int operands_fit (skC_code *code, pure_intrinsic *p, fold_entry *args)
+{
+	skO    *obj;
+	size_t i;
+
+	for (i = 0; i < p->arity; i++) {
+		obj = fold_operand(code, &args[i]);
+
+		switch (p->operands) {
+		case FOLD_NUMBERS:
+			if (obj->tag != SKO_NUMBER && obj->tag != SKO_INTEGER)
+				return 0;
+			break;
+		case FOLD_BOOLEANS:
+			if (obj->tag != SKO_BOOLEAN)
+				return 0;
+			break;
+		case FOLD_CONS:
+			if (i == 0 && obj->tag != SKO_LIST)
+				return 0;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return 1;
+}
+
+/*
+Return the pure intrinsic `sym' resolves to in `env', or NULL.
+*/
+pure_intrinsic *pure_intrinsic_of (skE *env, symbol *sym)
+{
+	size_t i;
+
+	if (sym->defs || !skE_lookupNative(env, sym))
+		return NULL;
+
+	for (i = 0; i < PURE_INTRINSICS; i++) {
+		if (sym == pure_syms[i])
+			return &pure_intrinsics[i];
+	}
+
+	return NULL;
+}
+
+/*
+Run the intrinsic on copies of the operands, on the stack of `env', and
+return its result. If it fails after all, the stack is put back as it was
+and NULL is returned.
+*/
+skO *fold_call (skE *env, skE_natOp *native, skC_code *code,
+	fold_entry *args, size_t arity)
+{
+	size_t  depth = env->depth;
+	jmp_buf jmp;
+	skO     *result;
+	size_t  i;
+
+	memcpy(jmp, env->jmp, sizeof(jmp_buf));
+
+	if (setjmp(env->jmp)) {
+		memcpy(env->jmp, jmp, sizeof(jmp_buf));
+		while (env->depth > depth)
+			skO_free(skE_stackPop(env));
+		return NULL;
+	}
+
+	for (i = 0; i < arity; i++)
+		skE_stackPushCopy(env, fold_operand(code, &args[i]));
+
+	native(env);
+	result = skE_stackPop(env);
+
+	memcpy(env->jmp, jmp, sizeof(jmp_buf));
+
+	return result;
+}
+
+/*
+Turn the entries that are results into `SKC_CONST' instructions. `end' is
+the index of the instruction following the last entry.
+*/
+void fold_flush (skC_code *code, fold_entry *stack, size_t depth, size_t end)
+{
+	skC_ins *ins;
+	size_t  i;
+
+	for (i = 0; i < depth; i++) {
+		if (!stack[i].value)
+			continue;
+
+		ins        = &code->ins[stack[i].start];
+		ins->op    = SKC_CONST;
+		ins->value = stack[i].value;
+		ins->span  = (i + 1 < depth ? stack[i + 1].start : end)
+			- stack[i].start;
+	}
+}
+
+/*
+Calls to pure intrinsics whose operands are all literals, or results of
+such calls, are computed once and for all. A run of instructions computing
+a single object becomes an `SKC_CONST' pushing it; like superinstructions,
+it checks when it runs that none of the intrinsics it stands for has been
+shadowed since, and performs its first instruction otherwise.
+*/
+void fold_constants (skE *env, skC_code *code)
+{
+	fold_entry     *stack = malloc(code->length * sizeof(fold_entry));
+	size_t         depth  = 0;
+	pure_intrinsic *p;
+	skC_ins        *ins;
+	skO            *result;
+	size_t         i;
+
+	if (!stack)
+		FATAL("INTERPRETER ERROR! Out of memory.\n");
+
+	for (ins = code->ins; ; ins++) {
+		if (ins->op == SKC_PUSH) {
+			stack[depth].value = NULL;
+			stack[depth].start = ins - code->ins;
+			depth++;
+			continue;
+		}
+
+		if ((ins->op == SKC_CALL || ins->op == SKC_TAIL)
+			&& (p = pure_intrinsic_of(env, ins->sym))
+			&& p->arity <= depth
+			&& operands_fit(code, p, &stack[depth - p->arity])
+			&& (result = fold_call(env, skE_lookupNative(env, ins->sym),
+				code, &stack[depth - p->arity], p->arity))) {
+			for (i = depth - p->arity; i < depth; i++) {
+				if (stack[i].value)
+					skO_free(stack[i].value);
+			}
+			depth -= p->arity;
+			if (!p->arity)
+				stack[depth].start = ins - code->ins;
+			stack[depth].value = result;
+			depth++;
+			continue;
+		}
+
+		fold_flush(code, stack, depth, ins - code->ins);
+		depth = 0;
+
+		if (ins->op == SKC_END)
+			break;
+	}
+
+	free(stack);
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                 PEEPHOLE                                 //
+////////////////////////////////////////////////////////////////////////////*/
+
+size_t fused_span (skC_op op)
+{
+	switch (op) {
+	case SKC_DUP:     return 3;
+	case SKC_SWAP:    return 4;
+	case SKC_OPERAND: return 2;
+	case SKC_UNLESS:  return 3;
+	default:          return 1;
+	}
+}
+
+int is_operand_call (skC_ins *ins)
+{
+	size_t i;
+
+	if (ins->op != SKC_CALL && ins->op != SKC_TAIL)
+		return 0;
+
+	for (i = 0; i < sizeof(operand_syms) / sizeof(symbol *); i++) {
+		if (ins->sym == operand_syms[i])
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+Return the superinstruction starting at `ins', or the op of `ins' itself if
+none does. The code ends with `SKC_END', which matches no pattern, so the
+tests never look past it.
+*/
+skC_op fused_op (skC_ins *ins)
+{
+	symbol *x = ins[0].sym;
+
+	switch (ins[0].op) {
+	case SKC_RESERVE:
+		if (ins[1].op == SKC_CALL && ins[1].sym == x
+			&& ins[2].op == SKC_RESTORE && ins[2].sym == x)
+			return SKC_DUP;
+		if (ins[1].op == SKC_RESERVE && ins[1].sym != x
+			&& ins[2].op == SKC_RESTORE && ins[2].sym == x
+			&& ins[3].op == SKC_RESTORE && ins[3].sym == ins[1].sym)
+			return SKC_SWAP;
+		if (ins[1].op == SKC_END)
+			return SKC_DROP;
+		break;
+	case SKC_PUSH:
+		if (ins[0].obj->tag == SKO_INTEGER && is_operand_call(&ins[1]))
+			return SKC_OPERAND;
+		break;
+	case SKC_CALL:
+		if (x == sym_not && ins[1].op == SKC_PUSH
+			&& ins[1].obj->tag == SKO_LIST
+			&& (ins[2].op == SKC_CALL || ins[2].op == SKC_TAIL)
+			&& ins[2].sym == sym_exec_if)
+			return SKC_UNLESS;
+		break;
+	default:
+		break;
+	}
+
+	return ins[0].op;
+}
+
+void peephole (skC_code *code)
+{
+	skC_ins *ins = code->ins;
+
+	while (ins->op != SKC_END) {
+		if (ins->op != SKC_CONST) {
+			ins->op   = fused_op(ins);
+			ins->span = fused_span(ins->op);
+		}
+		ins += ins->span;
+	}
+
+	switch (code->ins[0].op) {
+	case SKC_DUP:
+	case SKC_SWAP:
+	case SKC_DROP:
+		if (code->ins[code->ins[0].span].op == SKC_END)
+			code->idiom = code->ins[0].op;
+		break;
+	default:
+		break;
+	}
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                 COMPILER                                 //
+////////////////////////////////////////////////////////////////////////////*/
+
+skC_code *skC_compile (skE *env, skO *body)
+{
+	skC_code *code;
+	skC_ins  *ins;
+	skO      *tok;
+	size_t   count;
+	skC_op   op;
+
+	skO_checkList(body);
+	skC_init();
+
+	count = body->length + 1; /* final SKC_END */
+
+	code         = malloc(sizeof(skC_code) + count * sizeof(skC_ins));
+	code->locals = malloc(count * sizeof(symbol *));
+	code->nslots = 0;
+	code->idiom  = SKC_END;
+	ins          = code->ins;
+
+	tok = body->data.list;
+	while (tok) {
+		ins->sym     = NULL;
+		ins->obj     = tok;
+		ins->cache   = NULL;
+		ins->version = 0;
+		ins->slot    = 0;
+		ins->span    = 1;
+		ins->value   = NULL;
+
+		if (tok->tag == SKO_QSYMBOL && tok->next
+			&& tok->next->tag == SKO_SYMBOL
+			&& (op = reserving_op(tok->next->data.sym)) != SKC_END) {
+			ins->op  = op;
+			ins->sym = tok->data.sym;
+			if (op == SKC_RESERVE || op == SKC_RESTORE)
+				ins->slot = local_slot(code, ins->sym);
+			tok = tok->next;
+		} else if (tok->tag == SKO_SYMBOL) {
+			#ifdef SK_O_TAIL
+			ins->op  = tok->next ? SKC_CALL : SKC_TAIL;
+			#else
+			ins->op  = SKC_CALL;
+			#endif
+			ins->sym = tok->data.sym;
+		} else {
+			ins->op  = SKC_PUSH;
+		}
+
+		ins++;
+		tok = tok->next;
+	}
+
+	ins->op      = SKC_END;
+	ins->sym     = NULL;
+	ins->obj     = NULL;
+	ins->cache   = NULL;
+	ins->version = 0;
+	ins->slot    = 0;
+	ins->span    = 1;
+	ins->value   = NULL;
+
+	code->length = ins - code->ins + 1;
+
+	if (env)
+		fold_constants(env, code);
+	peephole(code);
+
+	return code;
+}
+
+char *op_names[] = {
+	"PUSH", "CALL", "TAIL", "RESERVE", "RESTORE", "DEFINE", "DUP", "SWAP",
+	"DROP", "OPERAND", "UNLESS", "CONST", "END"
+};
+
+void dump_token (FILE *f, skO *tok)
+{
+	switch (tok->tag) {
+	case SKO_INTEGER:   fprintf(f, "%lld", tok->data.integer);             break;
+	case SKO_NUMBER:    fprintf(f, "%g", tok->data.number);                break;
+	case SKO_BOOLEAN:   fprintf(f, tok->data.boolean ? "TRUE" : "FALSE"); break;
+	case SKO_CHARACTER: fprintf(f, "'%c", tok->data.character);           break;
+	case SKO_QSYMBOL:   fprintf(f, ":%s", tok->data.sym->name);           break;
+	case SKO_SYMBOL:    fprintf(f, "%s", tok->data.sym->name);            break;
+	case SKO_STRING:    fprintf(f, "\"%.*s\"", (int)tok->length,
+	                            tok->data.string ? tok->data.string : ""); break;
+	case SKO_LIST:      fprintf(f, "[%lu]", (unsigned long)tok->length);   break;
+	}
+}
+
+void skC_dump (FILE *f, symbol *name, skC_code *code)
+{
+	skC_ins *ins;
+	size_t  skip = 0;
+
+	fprintf(f, "%s (%lu slots):\n", name->name, (unsigned long)code->nslots);
+
+	for (ins = code->ins; ins < code->ins + code->length; ins++) {
+		fprintf(f, "  %3lu %s%s", (unsigned long)(ins - code->ins),
+			skip ? "  " : "", op_names[ins->op]);
+
+		if (ins->op == SKC_PUSH || ins->op == SKC_OPERAND) {
+			fputc(' ', f);
+			dump_token(f, ins->obj);
+		} else if (ins->op == SKC_CONST) {
+			fputc(' ', f);
+			dump_token(f, ins->value);
+		} else if (ins->sym) {
+			fprintf(f, " %s", ins->sym->name);
+		}
+
+		if (ins->op == SKC_RESERVE || ins->op == SKC_RESTORE
+			|| ins->op == SKC_DUP || ins->op == SKC_SWAP
+			|| ins->op == SKC_DROP)
+			fprintf(f, " [%lu]", (unsigned long)ins->slot);
+
+		fputc('\n', f);
+
+		if (skip)
+			skip--;
+		else
+			skip = ins->span - 1;
+	}
+}
+
+void skC_free (skC_code *code)
+{
+	size_t i;
+
+	for (i = 0; i < code->length; i++) {
+		if (code->ins[i].value)
+			skO_free(code->ins[i].value);
+	}
+
+	free(code->locals);
+	free(code);
+}
@@ -1,29 +1,88 @@
 /* Copyright (c) 2013, Jeremy Pinat. */
 
+#ifndef SK_NO_MMAP
+#define _POSIX_C_SOURCE 200112L
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "shirka.h"
 
 void load_intrinsics (skE *env);
-
-skO *skE_stackPop (skE *env)
+int  integer_operand (skE *env, skE_natOp *native, long long k);
+void memo_call       (skE *env, reserved *r);
+skO  *skI_not        (skE *env);
+skO  *skI_exec_if    (skE *env);
+skO  *skI_reverse    (skE *env);
+
+/*
+The stack grows by doubling its capacity, starting with room for
+`SK_STACK_SIZE' values. It never shrinks.
+*/
+#define SK_STACK_SIZE 64
+
+void stack_grow (skE *env)
 {
-	skO *obj;
+	env->capacity = env->capacity ? env->capacity * 2 : SK_STACK_SIZE;
+	env->stack    = realloc(env->stack, env->capacity * sizeof(skV));
+
+	if (!env->stack)
+		FATAL("INTERPRETER ERROR! Out of memory.\n");
+}
 
-	if (!env->stack) {
+skV skE_stackPopValue (skE *env)
+{
+	if (!env->depth) {
 		fprintf(stderr, "PANIC! Tried to pop object but stack is empty.\n");
 		longjmp(env->jmp, 1);
 	}
-	obj = env->stack;
-	env->stack = obj->next;
-	obj->next = NULL;
-	return obj;
+
+	env->depth--;
+	SKE_TOUCH(env, env->depth);
+
+	return env->stack[env->depth];
+}
+
+void skE_stackPushValue (skE *env, skV v)
+{
+	if (env->depth == env->capacity)
+		stack_grow(env);
+
+	env->stack[env->depth++] = v;
+
+	if (env->depth > sk_counters.peak_depth)
+		sk_counters.peak_depth = env->depth;
+}
+
+skO *skE_stackPop (skE *env)
+{
+	return skV_box(skE_stackPopValue(env));
 }
 
 void skE_stackPush (skE *env, skO *obj)
 {
-	obj->next = env->stack;	
-	env->stack = obj;
+	skV v = skV_of(obj);
+
+	if (SKV_BOXED(v.tag))
+		obj->next = NULL;
+	else
+		skO_free(obj);
+
+	skE_stackPushValue(env, v);
+}
+
+void skE_stackPushCopy (skE *env, skO *obj)
+{
+	skV v = skV_of(obj);
+
+	if (SKV_BOXED(v.tag))
+		v.data.obj = skO_clone(obj);
+
+	skE_stackPushValue(env, v);
 }
 
 context *scope_get (skE *env)
@@ -31,51 +90,91 @@ context *scope_get (skE *env)
 	return env->scope;
 }
 
-reserved *scope_find (skE *env, skO *sym)
+/*
+Return the frame slot of `sym' in a context, or NULL if it has none.
+*/
+frame_slot *context_slot (context *ct, symbol *sym)
 {
-	context *current_scope = env->scope;
-	reserved *node;
-	reserved *next;
+	size_t i;
 
-	skO_checkType(sym, SKO_SYMBOL);
+	for (i = 0; i < ct->nslots; i++) {
+		if (ct->slots[i].def.sym == sym)
+			return &ct->slots[i];
+	}
 
-	while (current_scope) {
-		node = current_scope->first_def;
-		while (node) {
-			next = node->next;
-			if (node->sym == sym->data.sym) {
-				return node;
-			}
-			node = next;
-		}
-		current_scope = current_scope->parent;
+	return NULL;
+}
+
+/*
+Find the most recent definition of `sym' in a context. Definitions chained
+to `first_def' are always more recent than the one held by a slot.
+*/
+reserved *context_find (context *ct, symbol *sym)
+{
+	reserved   *node = ct->first_def;
+	frame_slot *fs;
+
+	while (node) {
+		sk_counters.lookup_nodes++;
+		if (node->sym == sym)
+			return node;
+		node = node->next;
+	}
+
+	if (ct->nslots) {
+		fs = context_slot(ct, sym);
+		if (fs && fs->def.data.obj)
+			return &fs->def;
 	}
 
 	return NULL;
 }
 
-reserved *scope_find_current (skE *env, skO *sym)
+reserved *scope_lookup (skE *env, symbol *sym)
 {
+	context *current_scope = env->scope;
 	reserved *node;
-	reserved *next;
 
-	node = env->scope->first_def;
-	while (node) {
-		next = node->next;
-		if (node->sym == sym->data.sym) {
+	sk_counters.lookups++;
+
+	while (current_scope) {
+		node = context_find(current_scope, sym);
+		if (node)
 			return node;
-		}
-		node = next;
+		current_scope = current_scope->parent;
 	}
 
 	return NULL;
 }
 
+reserved *scope_find (skE *env, skO *sym)
+{
+	skO_checkType(sym, SKO_SYMBOL);
+
+	return scope_lookup(env, sym->data.sym);
+}
+
+reserved *scope_lookup_current (skE *env, symbol *sym)
+{
+	return context_find(env->scope, sym);
+}
+
+reserved *scope_find_current (skE *env, skO *sym)
+{
+	return scope_lookup_current(env, sym->data.sym);
+}
+
 skE *skE_new (void)
 {
 	skE *env = malloc(sizeof(skE));
-	env->stack = NULL;
-	env->scope = NULL;
+	env->stack    = NULL;
+	env->depth    = 0;
+	env->capacity = 0;
+	env->low      = 0;
+	env->scope    = NULL;
+	env->out      = NULL;
+	env->in       = NULL;
+	env->flags    = 0;
 
 	return env;
 }
@@ -83,12 +182,21 @@ skE *skE_new (void)
 void skE_init (skE *env)
 {
 	skE_scopePush(env);
+	env->out = sk_output_new(stdout, env->flags & SKE_LINE_BUFFERED);
+	env->in  = sk_input_new(stdin, env->out);
 	load_intrinsics(env);
 }
 
 void skE_free (skE *env)
 {
 	skE_scopePop(env);
+	while (env->depth)
+		skO_free(skE_stackPop(env));
+	free(env->stack);
+	if (env->out)
+		sk_output_free(env->out);
+	if (env->in)
+		sk_input_free(env->in);
 	free(env);
 }
 
@@ -97,69 +205,121 @@ void skE_defNative (skE *env, char *name, skE_natOp *native)
 	reserved *slot;
 	skO *obj = skO_symbol_new(name);
 
-	slot              = malloc(sizeof(reserved));
+	slot              = skM_alloc(sizeof(reserved));
 	slot->next        = env->scope->first_def;
 	slot->sym         = obj->data.sym;
 	slot->kind        = KIND_NATIVE;
 	slot->data.native = native;
+	slot->code        = NULL;
 
 	env->scope->first_def = slot;
+	slot->sym->version++;
 
 	skO_free(obj);
 }
 
-void skE_defObject (skE *env, skO *sym, skO *obj)
+void reserve_object (skE *env, symbol *sym, skO *obj)
 {
-	reserved *slot;
-
-	skO_checkType(sym, SKO_QSYMBOL);
-
-	if (scope_find_current(env, sym)) {
-		/* Release previously defined object? */
+	reserved   *slot;
+	frame_slot *fs = NULL;
+
+	if (scope_get(env)->nslots)
+		fs = context_slot(scope_get(env), sym);
+
+	if (fs) {
+		if (!fs->def.data.obj && !fs->overflow) {
+			fs->def.data.obj = obj;
+			sym->defs++;
+			sym->version++;
+			return;
+		}
+		fs->overflow++;
 	}
 
-	slot           = malloc(sizeof(reserved));
+	slot           = skM_alloc(sizeof(reserved));
 	slot->next     = scope_get(env)->first_def;
-	slot->sym      = sym->data.sym;
+	slot->sym      = sym;
 	slot->kind     = KIND_OBJECT;
 	slot->data.obj = obj;
+	slot->code     = NULL;
 
 	scope_get(env)->first_def = slot;
+	sym->defs++;
+	sym->version++;
+}
+
+void skE_defObject (skE *env, skO *sym, skO *obj)
+{
+	skO_checkType(sym, SKO_QSYMBOL);
+
+	if (scope_find_current(env, sym)) {
+		/* Release previously defined object? */
+	}
+
+	reserve_object(env, sym->data.sym, obj);
 
 	skO_free(sym);
 }
 
-void skE_defOperation (skE *env, skO *sym, skO *obj)
+void reserve_operation (skE *env, symbol *sym, skO *obj)
 {
-	reserved *slot;
+	reserved   *slot;
+	frame_slot *fs;
 
-	skO_checkType(sym, SKO_QSYMBOL);
-	skO_checkType(obj, SKO_LIST);
+	skO_checkList(obj);
 
-	if (scope_find_current(env, sym)) {
-		fprintf(stderr, "PANIC! Can't redefine reserved operation %s.\n", sym->data.sym->name);
+	if (scope_lookup_current(env, sym)) {
+		fprintf(stderr, "PANIC! Can't redefine reserved operation %s.\n", sym->name);
 		longjmp(env->jmp, 1);
 	}
 
-	slot           = malloc(sizeof(reserved));
+	if (scope_get(env)->nslots && (fs = context_slot(scope_get(env), sym)))
+		fs->overflow++;
+
+	slot           = skM_alloc(sizeof(reserved));
 	slot->next     = scope_get(env)->first_def;
-	slot->sym      = sym->data.sym;
+	slot->sym      = sym;
 	slot->kind     = KIND_OPERATION;
 	slot->data.obj = obj;
+	slot->code     = NULL;
+
+	if (!(env->flags & SKE_NO_COMPILE)) {
+		slot->code = skC_compile(env, obj);
+		#ifdef SK_COMPILER_DEBUG
+		skC_dump(stderr, sym, slot->code);
+		#endif
+	}
 
 	scope_get(env)->first_def = slot;
+	sym->defs++;
+	sym->version++;
+}
+
+void skE_defOperation (skE *env, skO *sym, skO *obj)
+{
+	skO_checkType(sym, SKO_QSYMBOL);
+
+	reserve_operation(env, sym->data.sym, obj);
 
 	skO_free(sym);
 }
 
-void skE_undef (skE *env, skO *sym)
+void restore_object (skE *env, symbol *sym)
 {
-	reserved *r;
-	reserved *node = scope_get(env)->first_def;
+	reserved   *r;
+	reserved   *node = scope_get(env)->first_def;
+	frame_slot *fs   = NULL;
 
-	skO_checkType(sym, SKO_QSYMBOL);
+	if (scope_get(env)->nslots)
+		fs = context_slot(scope_get(env), sym);
 
-	r = scope_find_current(env, sym);
+	if (fs && !fs->overflow) {
+		r = fs->def.data.obj ? &fs->def : NULL;
+	} else {
+		r = node;
+		while (r && r->sym != sym)
+			r = r->next;
+	}
 
 	if (!r) {
 		fprintf(stderr, "PANIC! Reserved object not found in current scope.\n");
@@ -171,6 +331,18 @@ void skE_undef (skE *env, skO *sym)
 		longjmp(env->jmp, 1);
 	}
 
+	sym->defs--;
+	sym->version++;
+
+	if (fs && r == &fs->def) {
+		skE_stackPush(env, r->data.obj);
+		r->data.obj = NULL;
+		return;
+	}
+
+	if (fs)
+		fs->overflow--;
+
 	if (node == r) {
 		scope_get(env)->first_def = r->next;
 		
@@ -183,15 +355,94 @@ void skE_undef (skE *env, skO *sym)
 
 	r->next = NULL;
 	skE_stackPush(env, r->data.obj);
-	free(r);
+	skM_free(r, sizeof(reserved));
+}
+
+void skE_memoize (skE *env, skO *sym, size_t arity)
+{
+	reserved *r;
+
+	skO_checkType(sym, SKO_QSYMBOL);
+
+	r = scope_lookup_current(env, sym->data.sym);
+	if (!r || r->kind != KIND_OPERATION) {
+		fprintf(stderr, "PANIC! Can't memoize %s: not an operation of the "
+			"current scope.\n", sym->data.sym->name);
+		longjmp(env->jmp, 1);
+	}
+
+	r->kind      = KIND_MEMO;
+	r->data.memo = sk_memo_new(r->data.obj, r->code, arity);
+	r->code      = NULL;
+	sym->data.sym->version++;
+
+	skO_free(sym);
+}
+
+void skE_undef (skE *env, skO *sym)
+{
+	skO_checkType(sym, SKO_QSYMBOL);
+
+	restore_object(env, sym->data.sym);
+
 	skO_free(sym);
 }
 
 void skE_scopePush (skE *env)
 {
-	context *ct = malloc(sizeof(context));
+	context *ct = skM_alloc(sizeof(context));
+	sk_counters.scope_pushes++;
+	ct->parent = env->scope;
+	ct->first_def = NULL;
+	ct->frame = NULL;
+	ct->nslots = 0;
+	env->scope = ct;
+}
+
+int context_empty (context *ct)
+{
+	size_t i;
+
+	if (ct->first_def)
+		return 0;
+
+	for (i = 0; i < ct->nslots; i++) {
+		if (ct->slots[i].def.data.obj)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+Go in scope for a call to compiled code, allocating its frame slots.
+*/
+void scope_push_frame (skE *env, skC_code *code)
+{
+	context *ct;
+	size_t  i;
+
+	if (!code->nslots) {
+		skE_scopePush(env);
+		return;
+	}
+
+	ct = skM_alloc(sizeof(context) + code->nslots * sizeof(frame_slot));
+	sk_counters.scope_pushes++;
 	ct->parent = env->scope;
 	ct->first_def = NULL;
+	ct->frame = code;
+	ct->nslots = code->nslots;
+
+	for (i = 0; i < code->nslots; i++) {
+		ct->slots[i].def.next     = NULL;
+		ct->slots[i].def.sym      = code->locals[i];
+		ct->slots[i].def.kind     = KIND_OBJECT;
+		ct->slots[i].def.data.obj = NULL;
+		ct->slots[i].def.code     = NULL;
+		ct->slots[i].overflow     = 0;
+	}
+
 	env->scope = ct;
 }
 
@@ -216,6 +467,7 @@ void skE_scopePop (skE *env)
 {
 	reserved *node;
 	reserved *next;
+	size_t i;
 	context *expired = env->scope;
 
 	#ifdef SK_DEBUG_SCOPE
@@ -225,18 +477,35 @@ void skE_scopePop (skE *env)
 	#endif
 
 	env->scope = expired->parent;
+	sk_counters.scope_pops++;
 
 	node = expired->first_def;
 	while (node) {
 		next = node->next;
+		node->sym->version++;
 		if (node->kind == KIND_OBJECT || node->kind == KIND_OPERATION) {
+			node->sym->defs--;
 			skO_free(node->data.obj);
+		} else if (node->kind == KIND_MEMO) {
+			node->sym->defs--;
+			sk_memo_free(node->data.memo);
 		}
-		free(node);
+		if (node->code)
+			skC_free(node->code);
+		skM_free(node, sizeof(reserved));
 		node = next;
 	}
 
-	free(expired);
+	for (i = 0; i < expired->nslots; i++) {
+		node = &expired->slots[i].def;
+		if (node->data.obj) {
+			node->sym->defs--;
+			node->sym->version++;
+			skO_free(node->data.obj);
+		}
+	}
+
+	skM_free(expired, sizeof(context) + expired->nslots * sizeof(frame_slot));
 }
 
 void skE_call (skE *env, skO *sym)
@@ -249,70 +518,266 @@ void skE_call (skE *env, skO *sym)
 	skO_free(list);
 }
 
-void skE_execList (skE *env, skO *list, int scoping)
+reserved *resolve (skE *env, symbol *sym)
 {
-	skO *cont;
-	skO *head = list->data.list;
-	skO *tok;
-	reserved *r;
+	reserved *r = scope_lookup(env, sym);
 
-	list->data.list = NULL;
-	skO_free(list);
+	if (!r) {
+		fprintf(stderr, "PANIC! Not found: %s\n", sym->name);
+		longjmp(env->jmp, 1);
+	}
 
-	if (scoping)
-		skE_scopePush(env);
+	return r;
+}
+
+skE_natOp *skE_lookupNative (skE *env, symbol *sym)
+{
+	reserved *r = scope_lookup(env, sym);
+
+	return r && r->kind == KIND_NATIVE ? r->data.native : NULL;
+}
+
+/*
+Resolve the symbol of a call instruction, going through its inline cache.
+*/
+reserved *resolve_cached (skE *env, skC_ins *ins)
+{
+	if (ins->version != ins->sym->version) {
+		ins->cache   = resolve(env, ins->sym);
+		ins->version = ins->sym->version;
+	}
+
+	return ins->cache;
+}
+
+/*
+Profiling hooks (see `profile.c'). They expand to nothing unless the
+interpreter is built with `SK_PROFILE'.
+*/
+#ifdef SK_PROFILE
+#define PROFILE_ENTER(sym) sk_profile_enter(sym)
+#define PROFILE_LEAVE()    sk_profile_leave()
+#define PROFILE_TAIL(sym)  do {                                             \
+	if (tailed)                                                          \
+		sk_profile_leave();                                          \
+	tailed = 1;                                                          \
+	sk_profile_enter(sym);                                               \
+} while (0)
+#else
+#define PROFILE_ENTER(sym)
+#define PROFILE_LEAVE()
+#define PROFILE_TAIL(sym)
+#endif
+
+/*
+Superinstructions and idioms (see `compiler.c'). These functions return 0,
+leaving the stack untouched, when the sequence of instructions they stand
+for must be performed one instruction at a time instead: when the
+intrinsics it uses are shadowed, or when the operands are not what the fast
+path expects (the normal path then reports errors as usual).
+*/
+int stack_dup (skE *env)
+{
+	skV v;
+
+	if (!env->depth || sk_sym_reserve->defs || sk_sym_restore->defs)
+		return 0;
+
+	v = env->stack[env->depth - 1];
+	if (SKV_BOXED(v.tag))
+		v.data.obj = skO_clone(v.data.obj);
+
+	skE_stackPushValue(env, v);
+
+	return 1;
+}
+
+int stack_swap (skE *env)
+{
+	skV v;
+
+	if (env->depth < 2 || sk_sym_reserve->defs || sk_sym_restore->defs)
+		return 0;
+
+	v = env->stack[env->depth - 1];
+	env->stack[env->depth - 1] = env->stack[env->depth - 2];
+	env->stack[env->depth - 2] = v;
+	SKE_TOUCH(env, env->depth - 2);
+
+	return 1;
+}
+
+/*
+A drop reserves an object which is released with the scope, and nothing runs
+in between. This only holds if the code has a scope of its own (`scoped'):
+the top level of a module, for instance, reserves in the scope of its
+includer.
+*/
+int stack_drop (skE *env, int scoped)
+{
+	skV v;
+
+	if (!scoped || !env->depth || sk_sym_reserve->defs)
+		return 0;
+
+	v = env->stack[--env->depth];
+	SKE_TOUCH(env, env->depth);
+	if (SKV_BOXED(v.tag))
+		skO_free(v.data.obj);
+
+	return 1;
+}
+
+int perform_idiom (skE *env, skC_code *code, int scoped)
+{
+	if (!code)
+		return 0;
+
+	switch (code->idiom) {
+	case SKC_DUP:  return stack_dup(env);
+	case SKC_SWAP: return stack_swap(env);
+	case SKC_DROP: return stack_drop(env, scoped);
+	default:       return 0;
+	}
+}
+
+/*
+Dispatch of compiled code. With GCC-compatible compilers, instructions jump
+directly to the next one through a table of label addresses ("computed
+goto"); otherwise a regular `switch' is used.
+*/
+#if defined(__GNUC__) && !defined(SK_NO_COMPUTED_GOTO)
+#define SK_COMPUTED_GOTO
+#endif
 
-#ifdef SK_O_TAIL
-tail:
+#ifdef SK_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define INSTRUCTION(op) L_##op: sk_counters.instructions++;
+#define DISPATCH()      goto *labels[pc->op]
+#define NEXT()          pc++; DISPATCH()
+#else
+#define INSTRUCTION(op) case op: sk_counters.instructions++;
+#define DISPATCH()      continue
+#define NEXT()          pc++; continue
 #endif
+
+/*
+Execute code in an environment. Either `code' is not NULL and is run, or
+the chain of tokens starting at `head' is walked.
+
+If `owned' is set, the tokens are consumed while executing: literals are
+moved to the stack and other tokens are released. Otherwise the tokens are
+shared, typically the body of a defined operation: they are left untouched
+and only the literals pushed on the stack are copied.
+
+Tail calls are performed in the same C frame, switching between compiled
+code and token chains as needed.
+*/
+void exec (skE *env, skO *head, skC_code *code, int owned, int scoping)
+{
+	skO      *cont;
+	skO      *tok;
+	reserved   *r;
+	reserved   *r2;
+	skC_ins    *pc;
+	size_t     i;
+	frame_slot *fs;
+	#ifdef SK_PROFILE
+	int        tailed = 0; /* a tail call of this frame is being profiled */
+	#endif
+
+	#ifdef SK_COMPUTED_GOTO
+	static void *labels[] = {
+		&&L_SKC_PUSH, &&L_SKC_CALL, &&L_SKC_TAIL, &&L_SKC_RESERVE,
+		&&L_SKC_RESTORE, &&L_SKC_DEFINE, &&L_SKC_DUP, &&L_SKC_SWAP,
+		&&L_SKC_DROP, &&L_SKC_OPERAND, &&L_SKC_UNLESS, &&L_SKC_CONST,
+		&&L_SKC_END
+	};
+	#endif
+
+	if (scoping) {
+		if (code)
+			scope_push_frame(env, code);
+		else
+			skE_scopePush(env);
+	}
+
+	if (code)
+		goto run;
+
+walk:
 	while (head) {
 		tok = head;
 		head = head->next;
+		sk_counters.instructions++;
 
 		switch (tok->tag) {
 		case SKO_SYMBOL:
-			r = scope_find(env, tok);
-			if (!r) {
-				fprintf(stderr, "PANIC! Not found: %s\n", (tok->data.sym)->name);
-				longjmp(env->jmp, 1);
-			}
+			r = resolve(env, tok->data.sym);
+
 			switch (r->kind) {
 			case KIND_OBJECT:
-				skE_stackPush(env, skO_clone(r->data.obj));
+				skE_stackPushCopy(env, r->data.obj);
 				break;
 			case KIND_OPERATION:
 				#ifdef SK_O_TAIL
 				if (tok->next) {
-					skE_execList(env, skO_clone(r->data.obj), 1);
+					if (perform_idiom(env, r->code, 1))
+						break;
+					PROFILE_ENTER(r->sym);
+					exec(env, r->data.obj->data.list, r->code, 0, 1);
+					PROFILE_LEAVE();
 				} else {
-					skO_free(tok);
-					tok = skO_clone(r->data.obj);
-					head = tok->data.list;
-					tok->data.list = NULL;
-					skO_free(tok);
-					goto tail;
+					if (owned)
+						skO_free(tok);
+					if (perform_idiom(env, r->code, scoping))
+						goto done;
+					PROFILE_TAIL(r->sym);
+					if (r->code) {
+						code = r->code;
+						goto enter;
+					}
+					owned = 0;
+					head  = r->data.obj->data.list;
+					goto walk;
 				}
 				#else
-				skE_execList(env, skO_clone(r->data.obj), 1);
+				if (perform_idiom(env, r->code, 1))
+					break;
+				PROFILE_ENTER(r->sym);
+				exec(env, r->data.obj->data.list, r->code, 0, 1);
+				PROFILE_LEAVE();
 				#endif
 				break;
+			case KIND_MEMO:
+				PROFILE_ENTER(r->sym);
+				memo_call(env, r);
+				PROFILE_LEAVE();
+				break;
 			case KIND_NATIVE:
 				#ifdef SK_O_TAIL
+				PROFILE_ENTER(r->sym);
 				cont = r->data.native(env);
+				PROFILE_LEAVE();
 
 				if (cont) {
 					if (tok->next) {
 						skE_execList(env, cont, 1);
 					} else {
-						skO_free(tok);
-						head = cont->data.list;
+						if (owned)
+							skO_free(tok);
+						owned = 1;
+						head  = cont->data.list;
 						cont->data.list = NULL;
 						skO_free(cont);
-						goto tail;
+						goto walk;
 					}
 				}
 				#else
+				PROFILE_ENTER(r->sym);
 				cont = r->data.native(env);
+				PROFILE_LEAVE();
 				if (cont)
 					skE_execList(env, cont, 1);
 				#endif
@@ -322,14 +787,20 @@ tail:
 				longjmp(env->jmp, 1);
 			}
 
-			skO_free(tok);
+			if (owned)
+				skO_free(tok);
 			break;
 		case SKO_QSYMBOL:
 		case SKO_NUMBER:
+		case SKO_INTEGER:
 		case SKO_CHARACTER:
 		case SKO_LIST:
+		case SKO_STRING:
 		case SKO_BOOLEAN:
-			skE_stackPush(env, tok);
+			if (owned)
+				skE_stackPush(env, tok);
+			else
+				skE_stackPushCopy(env, tok);
 			break;
 		default:
 			fprintf(stderr, "PANIC! Internal type error.\n");
@@ -337,43 +808,410 @@ tail:
 		}
 	}
 
+	goto done;
+
+enter:
+	/*
+	Tail calls run in the scope of their caller. While that scope holds no
+	definition yet, it can be traded for a frame laid out for the new code.
+	*/
+	if (scoping && code->nslots && env->scope->frame != code
+		&& context_empty(env->scope)) {
+		skE_scopePop(env);
+		scope_push_frame(env, code);
+	}
+
+run:
+	pc = code->ins;
+
+	#ifdef SK_COMPUTED_GOTO
+	DISPATCH();
+	#else
+	while (1) switch (pc->op) {
+	#endif
+
+	INSTRUCTION(SKC_PUSH)
+		skE_stackPushCopy(env, pc->obj);
+		NEXT();
+
+	INSTRUCTION(SKC_CALL)
+		r = resolve_cached(env, pc);
+	call:
+		switch (r->kind) {
+		case KIND_OBJECT:
+			skE_stackPushCopy(env, r->data.obj);
+			break;
+		case KIND_OPERATION:
+			if (perform_idiom(env, r->code, 1))
+				break;
+			PROFILE_ENTER(r->sym);
+			exec(env, r->data.obj->data.list, r->code, 0, 1);
+			PROFILE_LEAVE();
+			break;
+		case KIND_MEMO:
+			PROFILE_ENTER(r->sym);
+			memo_call(env, r);
+			PROFILE_LEAVE();
+			break;
+		case KIND_NATIVE:
+			PROFILE_ENTER(r->sym);
+			cont = r->data.native(env);
+			PROFILE_LEAVE();
+			if (cont)
+				skE_execList(env, cont, 1);
+			break;
+		default:
+			fprintf(stderr, "PANIC! Internal kind error.\n");
+			longjmp(env->jmp, 1);
+		}
+		NEXT();
+
+	INSTRUCTION(SKC_TAIL)
+		r = resolve_cached(env, pc);
+	tail:
+		switch (r->kind) {
+		case KIND_OBJECT:
+			skE_stackPushCopy(env, r->data.obj);
+			goto done;
+		case KIND_OPERATION:
+			if (perform_idiom(env, r->code, scoping))
+				goto done;
+			PROFILE_TAIL(r->sym);
+			if (r->code) {
+				code = r->code;
+				goto enter;
+			}
+			owned = 0;
+			head  = r->data.obj->data.list;
+			goto walk;
+		case KIND_MEMO:
+			PROFILE_ENTER(r->sym);
+			memo_call(env, r);
+			PROFILE_LEAVE();
+			goto done;
+		case KIND_NATIVE:
+			PROFILE_ENTER(r->sym);
+			cont = r->data.native(env);
+			PROFILE_LEAVE();
+			if (!cont)
+				goto done;
+			owned = 1;
+			head  = cont->data.list;
+			cont->data.list = NULL;
+			skO_free(cont);
+			goto walk;
+		default:
+			fprintf(stderr, "PANIC! Internal kind error.\n");
+			longjmp(env->jmp, 1);
+		}
+
+	INSTRUCTION(SKC_RESERVE)
+	reserve:
+		if (sk_sym_reserve->defs)
+			goto shadowed;
+		if (env->scope->frame == code) {
+			fs = &env->scope->slots[pc->slot];
+			if (!fs->def.data.obj && !fs->overflow) {
+				fs->def.data.obj = skE_stackPop(env);
+				pc->sym->defs++;
+				pc->sym->version++;
+				NEXT();
+			}
+		}
+		reserve_object(env, pc->sym, skE_stackPop(env));
+		NEXT();
+
+	INSTRUCTION(SKC_RESTORE)
+		if (sk_sym_restore->defs)
+			goto shadowed;
+		if (env->scope->frame == code) {
+			fs = &env->scope->slots[pc->slot];
+			if (fs->def.data.obj && !fs->overflow) {
+				skE_stackPush(env, fs->def.data.obj);
+				fs->def.data.obj = NULL;
+				pc->sym->defs--;
+				pc->sym->version++;
+				NEXT();
+			}
+		}
+		restore_object(env, pc->sym);
+		NEXT();
+
+	INSTRUCTION(SKC_DEFINE)
+		if (sk_sym_define->defs)
+			goto shadowed;
+		reserve_operation(env, pc->sym, skE_stackPop(env));
+		NEXT();
+
+	/*
+	Superinstructions stand for `span' instructions. When they cannot run,
+	the first of them is performed instead.
+	*/
+	INSTRUCTION(SKC_DUP)
+		if (!stack_dup(env))
+			goto reserve;
+		pc += pc->span;
+		DISPATCH();
+
+	INSTRUCTION(SKC_SWAP)
+		if (!stack_swap(env))
+			goto reserve;
+		pc += pc->span;
+		DISPATCH();
+
+	INSTRUCTION(SKC_DROP)
+		if (!stack_drop(env, scoping))
+			goto reserve;
+		NEXT();
+
+	INSTRUCTION(SKC_OPERAND)
+		r = resolve_cached(env, pc + 1);
+		if (r->kind == KIND_NATIVE
+			&& integer_operand(env, r->data.native, pc->obj->data.integer)) {
+			pc += pc->span;
+			DISPATCH();
+		}
+		skE_stackPushCopy(env, pc->obj);
+		NEXT();
+
+	INSTRUCTION(SKC_UNLESS)
+		r  = resolve_cached(env, pc);
+		r2 = resolve_cached(env, pc + 2);
+		if (r->kind == KIND_NATIVE && r->data.native == &skI_not
+			&& r2->kind == KIND_NATIVE && r2->data.native == &skI_exec_if
+			&& env->depth
+			&& env->stack[env->depth - 1].tag == SKO_BOOLEAN) {
+			env->depth--;
+			SKE_TOUCH(env, env->depth);
+			if (pc[2].op == SKC_TAIL) {
+				if (env->stack[env->depth].data.boolean)
+					goto done;
+				owned = 0;
+				head  = pc[1].obj->data.list;
+				goto walk;
+			}
+			if (!env->stack[env->depth].data.boolean)
+				exec(env, pc[1].obj->data.list, NULL, 0, 1);
+			pc += pc->span;
+			DISPATCH();
+		}
+		goto call;
+
+	INSTRUCTION(SKC_CONST)
+		for (i = 0; i < pc->span; i++) {
+			if (pc[i].sym && pc[i].sym->defs)
+				break;
+		}
+		if (i == pc->span) {
+			skE_stackPushCopy(env, pc->value);
+			pc += pc->span;
+			DISPATCH();
+		}
+		if (!pc->sym) {
+			skE_stackPushCopy(env, pc->obj);
+			NEXT();
+		}
+		r = resolve_cached(env, pc);
+		goto call;
+
+	/*
+	The reserving intrinsic has been redefined: push the quoted symbol and
+	call whatever it now resolves to.
+	*/
+	shadowed:
+		skE_stackPushCopy(env, pc->obj);
+		r = resolve(env, pc->obj->next->data.sym);
+		#ifdef SK_O_TAIL
+		if (pc[1].op == SKC_END)
+			goto tail;
+		#endif
+		goto call;
+
+	INSTRUCTION(SKC_END)
+		goto done;
+
+	#ifndef SK_COMPUTED_GOTO
+	}
+	#endif
+
+done:
+	#ifdef SK_PROFILE
+	if (tailed)
+		sk_profile_leave();
+	#endif
+
 	if (scoping)
 		skE_scopePop(env);
 }
 
+#ifdef SK_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+/*
+Call a memoized operation: its results are taken from the cache if its
+arguments are there, otherwise it runs, in a frame of its own even in tail
+position, so that its results can be recorded. If it fails, the pending
+entry is discarded before the error is passed on.
+*/
+void memo_call (skE *env, reserved *r)
+{
+	sk_memo       *memo = r->data.memo;
+	sk_memo_entry *entry;
+	size_t        low   = env->low;
+	jmp_buf       jmp;
+
+	if (sk_memo_lookup(memo, env))
+		return;
+
+	entry    = sk_memo_begin(memo, env);
+	env->low = env->depth;
+
+	memcpy(jmp, env->jmp, sizeof(jmp_buf));
+
+	if (setjmp(env->jmp)) {
+		memcpy(env->jmp, jmp, sizeof(jmp_buf));
+		sk_memo_discard(memo, entry);
+		env->low = low;
+		longjmp(env->jmp, 1);
+	}
+
+	exec(env, sk_memo_body(memo)->data.list, sk_memo_code(memo), 0, 1);
+
+	memcpy(env->jmp, jmp, sizeof(jmp_buf));
+	sk_memo_end(memo, entry, env);
+
+	if (low < env->low)
+		env->low = low;
+}
+
+void skE_execList (skE *env, skO *list, int scoping)
+{
+	skO *head = list->data.list;
+
+	list->data.list = NULL;
+	skO_free(list);
+
+	exec(env, head, NULL, 1, scoping);
+}
+
+/*
+Files are mapped in memory when possible and used in place, without being
+copied. Other inputs (pipes, the standard input stream when the path is `-',
+or systems built with `SK_NO_MMAP') are read in chunks into a growing buffer.
+
+The parser expects the source to be 0 terminated. A mapping gets this for
+free from the zero-filled end of its last page, unless the size of the file
+is a multiple of the page size; such files are read instead.
+*/
+
+#define SOURCE_CHUNK (64 * 1024)
+
+int source_map (sk_source *src, FILE *f)
+{
+	#ifndef SK_NO_MMAP
+	struct stat st;
+	long        page = sysconf(_SC_PAGESIZE);
+	void        *text;
+
+	if (fstat(fileno(f), &st) || !S_ISREG(st.st_mode) || st.st_size == 0
+		|| page <= 0 || st.st_size % page == 0)
+		return 0;
+
+	text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+	if (text == MAP_FAILED)
+		return 0;
+
+	src->text   = text;
+	src->length = st.st_size;
+	src->mapped = st.st_size;
+	return 1;
+	#else
+	(void)src;
+	(void)f;
+	return 0;
+	#endif
+}
+
+void source_read (sk_source *src, FILE *f)
+{
+	size_t capacity = SOURCE_CHUNK;
+	size_t n;
+	char   *text;
+
+	src->text   = malloc(capacity + 1);
+	src->length = 0;
+	src->mapped = 0;
+
+	if (!src->text)
+		FATAL("INTERPRETER ERROR! Out of memory.\n");
+
+	while ((n = fread(src->text + src->length, 1, capacity - src->length, f)) > 0) {
+		src->length += n;
+		if (src->length == capacity) {
+			capacity *= 2;
+			text = realloc(src->text, capacity + 1);
+			if (!text)
+				FATAL("INTERPRETER ERROR! Out of memory.\n");
+			src->text = text;
+		}
+	}
+
+	src->text[src->length] = 0;
+}
+
+int sk_source_open (sk_source *src, char *path)
+{
+	FILE *f;
+
+	if (strcmp(path, "-") == 0) {
+		source_read(src, stdin);
+		return 1;
+	}
+
+	f = fopen(path, "rb");
+	if (!f)
+		return 0;
+
+	if (!source_map(src, f))
+		source_read(src, f);
+
+	fclose(f);
+	return 1;
+}
+
+void sk_source_close (sk_source *src)
+{
+	#ifndef SK_NO_MMAP
+	if (src->mapped) {
+		munmap(src->text, src->mapped);
+		return;
+	}
+	#endif
+	free(src->text);
+}
+
 skO *skO_loadParse (char *path)
 {
-	FILE   *f;
-	size_t f_size;
-	char   *src;
-	char   *cursor;
-	skO    *ast;
-	jmp_buf jmp;
+	sk_source src;
+	char      *cursor;
+	skO       *ast;
+	jmp_buf   jmp;
 
 	if (setjmp(jmp)) {
 		fprintf(stderr, "Syntax error in file %s\n", path);
 		exit(EXIT_FAILURE);
 	}
 
-	f = fopen(path, "rb");
-	if (!f) {
+	if (!sk_source_open(&src, path)) {
 		fprintf(stderr, "INTERPRETER ERROR! Could not open file %s.\n", path);
 		exit(EXIT_FAILURE);
 	}
-	/* get file size */
-	fseek(f, 0, SEEK_END);
-	f_size = ftell(f);
-	fseek(f, 0, SEEK_SET);
-	/* copy source into string */
-	src = malloc(f_size);
-	fread(src, f_size, 1, f);
-	src[f_size] = 0;
-	fclose(f);
 
-	cursor = src;
+	cursor = src.text;
 	ast = skO_parse(&cursor, jmp, NULL);
 
-	free(src);
+	sk_source_close(&src);
 
 	return ast;
 }
@@ -386,6 +1224,7 @@ void load_intrinsics (skE *env)
 	skE_defNative(env, "!",         &skI_exec);
 	skE_defNative(env, "!?",        &skI_exec_if);
 	skE_defNative(env, "=",         &skI_eql);
+	skE_defNative(env, "hash",      &skI_hash);
 	skE_defNative(env, "$parse",    &skI_parse);
 	skE_defNative(env, "with",      &skI_with);
 	skE_defNative(env, "type?",     &skI_type);
@@ -397,10 +1236,14 @@ void load_intrinsics (skE *env)
 	skE_defNative(env, "length?",   &skI_length);
 	skE_defNative(env, "cons",      &skI_cons);
 	skE_defNative(env, "uncons",    &skI_uncons);
+	/* String operations */
+	skE_defNative(env, "list->string", &skI_list_to_string);
+	skE_defNative(env, "string->list", &skI_string_to_list);
 	/* Reserving operations */
 	skE_defNative(env, "$=>",       &skI_defOperation);
 	skE_defNative(env, "$->",       &skI_defObject);
 	skE_defNative(env, "$<-",       &skI_undef);
+	skE_defNative(env, "memoize",   &skI_memoize);
 	/* Boolean data */
 	skE_defNative(env, "TRUE",      &skI_true);
 	skE_defNative(env, "FALSE",     &skI_false);
@@ -421,4 +1264,26 @@ void load_intrinsics (skE *env)
 	/* IO operations */
 	skE_defNative(env, "print",     &skI_print);
 	skE_defNative(env, "getc",      &skI_getc);
+	skE_defNative(env, "stats",     &skI_stats);
+	skE_defNative(env, "flush",     &skI_flush);
+	skE_defNative(env, "read-line", &skI_read_line);
+	skE_defNative(env, "read-all",  &skI_read_all);
+	skE_defNative(env, "read-chunk", &skI_read_chunk);
+
+	/* Prelude operations, unless their Shirka versions are used */
+	if (env->flags & SKE_SHIRKA_PRELUDE)
+		return;
+	skE_defNative(env, "if",        &skI_if);
+	skE_defNative(env, "while",     &skI_while);
+	skE_defNative(env, "times",     &skI_times);
+	skE_defNative(env, "each",      &skI_each);
+	skE_defNative(env, "fold",      &skI_fold);
+	skE_defNative(env, "map",       &skI_map);
+	skE_defNative(env, "filter",    &skI_filter);
+	skE_defNative(env, "reverse",   &skI_reverse);
+	skE_defNative(env, "++",        &skI_concat);
+	skE_defNative(env, "append",    &skI_append);
+	skE_defNative(env, "take",      &skI_take);
+	skE_defNative(env, "split",     &skI_split);
+	skE_defNative(env, "included?", &skI_included);
 }
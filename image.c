@@ -0,0 +1,372 @@
+/* Copyright (c) 2013, Jeremy Pinat. */
+
+/*
+Images
+======
+
+Running the prelude at each start of the interpreter means reading, parsing
+and executing it again and again, although it always leaves the same
+definitions behind. An *image* is a snapshot of these definitions: once the
+prelude has run, the operations and objects reserved in the root scope are
+saved to a file, which later runs load instead of the prelude itself.
+
+Intrinsics are not part of images: they are defined by `skE_init' before the
+image is loaded.
+
+An image starts with a header identifying the format and the source it was
+built from (its size and a hash of its contents). It is considered stale,
+and ignored, as soon as the source changes. The header is followed by the
+definitions, oldest first; each of them is a kind, a name and an object:
+
+    kind     1 byte  (KIND_OBJECT or KIND_OPERATION)
+    name     length (4 bytes) and characters
+    object   tag (1 byte) and data
+
+where the data of an object depends on its tag:
+
+    number           8 bytes (double)
+    integer          8 bytes (long long)
+    boolean          1 byte
+    character        1 byte
+    (quoted) symbol  length (4 bytes) and characters
+    string           length (4 bytes) and bytes
+    list             number of elements (4 bytes) and elements
+
+Numbers and lengths are stored in the byte order of the machine: images are
+built along with the interpreter and are not meant to be portable.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "shirka.h"
+
+void reserve_object    (skE *env, symbol *sym, skO *obj);
+void reserve_operation (skE *env, symbol *sym, skO *obj);
+
+static const char IMAGE_MAGIC[8] = {'S', 'H', 'I', 'R', 'K', 'A', 'I', '3'};
+
+typedef struct {
+	char     magic[8];
+	uint64_t source_size;
+	uint64_t source_hash;   /* FNV-1a of the contents */
+	uint32_t count;         /* number of definitions */
+} image_header;
+
+/*
+Fill the source fields of a header. Return 0 if the source can't be found.
+*/
+int image_stamp (image_header *header, char *source)
+{
+	sk_source src;
+	uint64_t  h = 14695981039346656037ULL;
+	size_t    i;
+
+	if (!sk_source_open(&src, source))
+		return 0;
+
+	for (i = 0; i < src.length; i++)
+		h = (h ^ (unsigned char)src.text[i]) * 1099511628211ULL;
+
+	memset(header, 0, sizeof(*header));
+	memcpy(header->magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+	header->source_size = src.length;
+	header->source_hash = h;
+
+	sk_source_close(&src);
+
+	return 1;
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                 WRITING                                  //
+////////////////////////////////////////////////////////////////////////////*/
+
+void image_put_length (FILE *f, size_t length)
+{
+	uint32_t l = length;
+
+	fwrite(&l, sizeof(l), 1, f);
+}
+
+void image_put_name (FILE *f, symbol *sym)
+{
+	image_put_length(f, sym->length);
+	fwrite(sym->name, 1, sym->length, f);
+}
+
+void image_put_object (FILE *f, skO *obj)
+{
+	unsigned char tag = obj->tag;
+	skO           *node;
+
+	fputc(tag, f);
+
+	switch (obj->tag) {
+	case SKO_NUMBER:
+		fwrite(&obj->data.number, sizeof(double), 1, f);
+		break;
+	case SKO_INTEGER:
+		fwrite(&obj->data.integer, sizeof(long long), 1, f);
+		break;
+	case SKO_BOOLEAN:
+		fputc(obj->data.boolean != 0, f);
+		break;
+	case SKO_CHARACTER:
+		fputc(obj->data.character, f);
+		break;
+	case SKO_SYMBOL:
+	case SKO_QSYMBOL:
+		image_put_name(f, obj->data.sym);
+		break;
+	case SKO_STRING:
+		image_put_length(f, obj->length);
+		fwrite(obj->data.string, 1, obj->length, f);
+		break;
+	case SKO_LIST:
+		image_put_length(f, obj->length);
+		for (node = obj->data.list; node; node = node->next)
+			image_put_object(f, node);
+		break;
+	}
+}
+
+int skE_saveImage (skE *env, char *path, char *source)
+{
+	image_header header;
+	reserved     *def;
+	reserved     **defs;
+	size_t       count = 0;
+	FILE         *f;
+	int          ok;
+
+	if (!image_stamp(&header, source))
+		return 0;
+
+	for (def = env->scope->first_def; def; def = def->next) {
+		if (def->kind != KIND_NATIVE)
+			count++;
+	}
+
+	/* The scope lists definitions newest first. */
+	defs = malloc((count + 1) * sizeof(reserved *));
+	header.count = count;
+	for (def = env->scope->first_def; def; def = def->next) {
+		if (def->kind != KIND_NATIVE)
+			defs[--count] = def;
+	}
+
+	f = fopen(path, "wb");
+	if (!f) {
+		free(defs);
+		return 0;
+	}
+
+	fwrite(&header, sizeof(header), 1, f);
+
+	/* Memoized operations are saved as plain operations. */
+	for (count = 0; count < header.count; count++) {
+		def = defs[count];
+		if (def->kind == KIND_MEMO) {
+			fputc(KIND_OPERATION, f);
+			image_put_name(f, def->sym);
+			image_put_object(f, sk_memo_body(def->data.memo));
+		} else {
+			fputc(def->kind, f);
+			image_put_name(f, def->sym);
+			image_put_object(f, def->data.obj);
+		}
+	}
+
+	ok = !ferror(f);
+	ok = !fclose(f) && ok;
+	free(defs);
+
+	return ok;
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                 READING                                  //
+////////////////////////////////////////////////////////////////////////////*/
+
+/*
+The image is read through a cursor. Reading past its end sets `failed'
+instead of crashing, so that a truncated image is simply ignored.
+*/
+typedef struct {
+	char *at;
+	char *end;
+	int  failed;
+} image_cursor;
+
+char *image_take (image_cursor *c, size_t n)
+{
+	char *p = c->at;
+
+	if (c->failed || (size_t)(c->end - c->at) < n) {
+		c->failed = 1;
+		return NULL;
+	}
+
+	c->at += n;
+	return p;
+}
+
+int image_get_byte (image_cursor *c)
+{
+	char *p = image_take(c, 1);
+
+	return p ? (unsigned char)*p : 0;
+}
+
+size_t image_get_length (image_cursor *c)
+{
+	uint32_t l = 0;
+	char     *p = image_take(c, sizeof(l));
+
+	if (p)
+		memcpy(&l, p, sizeof(l));
+
+	return l;
+}
+
+symbol *image_get_name (image_cursor *c)
+{
+	size_t length = image_get_length(c);
+	char   *name  = image_take(c, length);
+
+	return name ? sk_symbol_intern(name, length) : NULL;
+}
+
+skO *image_get_object (image_cursor *c)
+{
+	int    tag = image_get_byte(c);
+	skO    *obj;
+	size_t length;
+	size_t i;
+	char   *p;
+	symbol *sym;
+
+	switch (tag) {
+	case SKO_NUMBER:
+		p = image_take(c, sizeof(double));
+		if (!p)
+			return NULL;
+		obj = skO_number_new(0);
+		memcpy(&obj->data.number, p, sizeof(double));
+		return obj;
+	case SKO_INTEGER:
+		p = image_take(c, sizeof(long long));
+		if (!p)
+			return NULL;
+		obj = skO_integer_new(0);
+		memcpy(&obj->data.integer, p, sizeof(long long));
+		return obj;
+	case SKO_BOOLEAN:
+		return skO_boolean_new(image_get_byte(c));
+	case SKO_CHARACTER:
+		return skO_character_new(image_get_byte(c));
+	case SKO_SYMBOL:
+	case SKO_QSYMBOL:
+		sym = image_get_name(c);
+		if (!sym)
+			return NULL;
+		obj = skO_symbol_new_n(sym->name, sym->length);
+		obj->tag = tag;
+		return obj;
+	case SKO_STRING:
+		length = image_get_length(c);
+		p      = image_take(c, length);
+		return p ? skO_string_new(p, length) : NULL;
+	case SKO_LIST:
+		length = image_get_length(c);
+		obj    = skO_list_new();
+		for (i = 0; i < length && !c->failed; i++)
+			sk_list_append(obj, image_get_object(c));
+		if (c->failed) {
+			skO_free(obj);
+			return NULL;
+		}
+		return obj;
+	default:
+		c->failed = 1;
+		return NULL;
+	}
+}
+
+int skE_loadImage (skE *env, char *path, char *source)
+{
+	image_header expected;
+	image_header header;
+	image_cursor c;
+	sk_source    image;
+	symbol       **names;
+	skO          **objects;
+	int          *kinds;
+	size_t       i;
+	size_t       n;
+	int          ok = 0;
+
+	if (!image_stamp(&expected, source) || !sk_source_open(&image, path))
+		return 0;
+
+	c.at     = image.text;
+	c.end    = image.text + image.length;
+	c.failed = 0;
+
+	if (image.length < sizeof(header))
+		goto close;
+
+	memcpy(&header, image_take(&c, sizeof(header)), sizeof(header));
+
+	if (memcmp(header.magic, expected.magic, sizeof(IMAGE_MAGIC))
+		|| header.source_size != expected.source_size
+		|| header.source_hash != expected.source_hash
+		|| header.count > image.length)
+		goto close;
+
+	/*
+	Decode everything before defining anything, so that a damaged image
+	leaves the environment untouched.
+	*/
+	names   = malloc((header.count + 1) * sizeof(symbol *));
+	objects = malloc((header.count + 1) * sizeof(skO *));
+	kinds   = malloc((header.count + 1) * sizeof(int));
+
+	for (n = 0; n < header.count; n++) {
+		kinds[n]   = image_get_byte(&c);
+		names[n]   = image_get_name(&c);
+		objects[n] = image_get_object(&c);
+
+		if (kinds[n] != KIND_OBJECT && kinds[n] != KIND_OPERATION)
+			c.failed = 1;
+
+		if (c.failed) {
+			if (objects[n])
+				skO_free(objects[n]);
+			break;
+		}
+	}
+
+	if (c.failed) {
+		for (i = 0; i < n; i++)
+			skO_free(objects[i]);
+	} else {
+		for (i = 0; i < header.count; i++) {
+			if (kinds[i] == KIND_OPERATION)
+				reserve_operation(env, names[i], objects[i]);
+			else
+				reserve_object(env, names[i], objects[i]);
+		}
+		ok = 1;
+	}
+
+	free(names);
+	free(objects);
+	free(kinds);
+
+close:
+	sk_source_close(&image);
+	return ok;
+}
@@ -0,0 +1,178 @@
+/* Copyright (c) 2013, Jeremy Pinat. */
+
+/*
+Input
+=====
+
+Environments read the standard input stream through a buffer of
+`SK_INPUT_SIZE' bytes, refilled with a single `read' each time it runs
+empty. Intrinsics can then take whole lines or blocks out of it at once
+instead of calling `fgetc' for each character.
+
+`read' returns as soon as some input is available, so that interactive
+programs still get each line as soon as it is typed. The output buffer tied
+to the input, if any, is flushed before each refill so that prompts are
+visible while waiting.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "shirka.h"
+
+#define SK_INPUT_SIZE (64 * 1024)
+
+struct sk_input {
+	int       fd;
+	sk_output *tie;    /* flushed before reading, or NULL   */
+	int       eof;     /* end of input reached               */
+	size_t    start;   /* first byte not consumed yet        */
+	size_t    end;     /* end of the bytes read              */
+	char      data[SK_INPUT_SIZE];
+};
+
+sk_input *sk_input_new (FILE *file, sk_output *tie)
+{
+	sk_input *in = malloc(sizeof(sk_input));
+
+	if (!in)
+		FATAL("INTERPRETER ERROR! Out of memory.\n");
+
+	in->fd    = fileno(file);
+	in->tie   = tie;
+	in->eof   = 0;
+	in->start = 0;
+	in->end   = 0;
+
+	return in;
+}
+
+void sk_input_free (sk_input *in)
+{
+	free(in);
+}
+
+/*
+Refill an empty buffer. Return 0 at the end of input.
+*/
+int input_fill (sk_input *in)
+{
+	ssize_t n;
+
+	if (in->eof)
+		return 0;
+
+	if (in->tie)
+		sk_output_flush(in->tie);
+
+	do {
+		n = read(in->fd, in->data, SK_INPUT_SIZE);
+	} while (n < 0 && errno == EINTR);
+
+	in->start = 0;
+	in->end   = n > 0 ? n : 0;
+
+	if (n <= 0)
+		in->eof = 1;
+
+	return n > 0;
+}
+
+int sk_input_getc (sk_input *in)
+{
+	if (in->start == in->end && !input_fill(in))
+		return EOF;
+
+	return (unsigned char)in->data[in->start++];
+}
+
+/*
+Bytes taken out of the buffer are collected in a growable array until the
+string is complete.
+*/
+typedef struct {
+	char   *data;
+	size_t length;
+	size_t capacity;
+} input_bytes;
+
+void bytes_add (input_bytes *b, const char *bytes, size_t length)
+{
+	if (!length)
+		return;
+
+	if (b->length + length > b->capacity) {
+		while (b->length + length > b->capacity)
+			b->capacity = b->capacity ? b->capacity * 2 : 256;
+
+		b->data = realloc(b->data, b->capacity);
+		if (!b->data)
+			FATAL("INTERPRETER ERROR! Out of memory.\n");
+	}
+
+	memcpy(b->data + b->length, bytes, length);
+	b->length += length;
+}
+
+skO *bytes_string (input_bytes *b)
+{
+	skO *str = skO_string_new(b->data, b->length);
+
+	free(b->data);
+
+	return str;
+}
+
+skO *sk_input_line (sk_input *in)
+{
+	input_bytes b = { NULL, 0, 0 };
+	char        *nl;
+	size_t      n;
+
+	if (in->start == in->end && !input_fill(in))
+		return NULL;
+
+	do {
+		n  = in->end - in->start;
+		nl = memchr(in->data + in->start, '\n', n);
+
+		if (nl) {
+			n = nl - (in->data + in->start);
+			bytes_add(&b, in->data + in->start, n);
+			in->start += n + 1;
+			break;
+		}
+
+		bytes_add(&b, in->data + in->start, n);
+		in->start = in->end;
+	} while (input_fill(in));
+
+	return bytes_string(&b);
+}
+
+skO *sk_input_read (sk_input *in, size_t max)
+{
+	input_bytes b = { NULL, 0, 0 };
+	size_t      n;
+
+	if (max && in->start == in->end && !input_fill(in))
+		return NULL;
+
+	while (b.length < max) {
+		if (in->start == in->end && !input_fill(in))
+			break;
+
+		n = in->end - in->start;
+		if (n > max - b.length)
+			n = max - b.length;
+
+		bytes_add(&b, in->data + in->start, n);
+		in->start += n;
+	}
+
+	return bytes_string(&b);
+}
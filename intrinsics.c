@@ -3,11 +3,26 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <limits.h>
+#include <string.h>
 #include "shirka.h"
 
 #define SK_INTRINSIC skO *
 
-void print_list (skO *list)
+void print_number (sk_output *out, skO *obj)
+{
+	char buffer[32];
+	int  length;
+
+	if (obj->tag == SKO_INTEGER)
+		length = sprintf(buffer, "%lld", obj->data.integer);
+	else
+		length = sprintf(buffer, "%.14g", obj->data.number);
+
+	sk_output_write(out, buffer, length);
+}
+
+void print_list (sk_output *out, skO *list)
 {
 	skO *node = list->data.list;
 
@@ -15,16 +30,21 @@ void print_list (skO *list)
 		switch (node->tag) {
 		case SKO_QSYMBOL:
 		case SKO_SYMBOL:
-			printf("%s", (node->data.sym)->name);
+			sk_output_write(out, node->data.sym->name,
+				node->data.sym->length);
 			break;
 		case SKO_NUMBER:
-			printf("%.14g", node->data.number);
+		case SKO_INTEGER:
+			print_number(out, node);
 			break;
 		case SKO_CHARACTER:
-			printf("%c", node->data.character);
+			sk_output_char(out, node->data.character);
 			break;
 		case SKO_LIST:
-			print_list(node);
+			print_list(out, node);
+			break;
+		case SKO_STRING:
+			sk_output_write(out, node->data.string, node->length);
 			break;
 		default:
 			break;
@@ -63,6 +83,26 @@ SK_INTRINSIC skI_undef (skE *env)
 	return NULL;
 }
 
+SK_INTRINSIC skI_memoize (skE *env)
+{
+	skV    arity = skE_stackPopValue(env);
+	skO    *sym  = skE_stackPop(env);
+	double n;
+
+	skV_checkType(&arity, SKO_NUMBER);
+	n = skV_double(arity);
+
+	if (n != floor(n) || n < 0 || n >= (double)(size_t)-1) {
+		fprintf(stderr, "PANIC! Invalid arity: %g.\n", n);
+		skO_free(sym);
+		longjmp(env->jmp, 1);
+	}
+
+	skE_memoize(env, sym, (size_t)n);
+
+	return NULL;
+}
+
 SK_INTRINSIC skI_print (skE *env)
 {
 	skO *obj = skE_stackPop(env);
@@ -70,22 +110,26 @@ SK_INTRINSIC skI_print (skE *env)
 	switch (obj->tag) {
 	case SKO_QSYMBOL:
 	case SKO_SYMBOL:
-		printf("%s", (obj->data.sym)->name);
+		sk_output_write(env->out, obj->data.sym->name, obj->data.sym->length);
 		break;
 	case SKO_NUMBER:
-		printf("%.14g", obj->data.number);
+	case SKO_INTEGER:
+		print_number(env->out, obj);
 		break;
 	case SKO_CHARACTER:
-		printf("%c", obj->data.character);
+		sk_output_char(env->out, obj->data.character);
 		break;
 	case SKO_LIST:
-		print_list(obj);
+		print_list(env->out, obj);
+		break;
+	case SKO_STRING:
+		sk_output_write(env->out, obj->data.string, obj->length);
 		break;
 	case SKO_BOOLEAN:
 		if (obj->data.boolean) {
-			printf("TRUE");
+			sk_output_write(env->out, "TRUE", 4);
 		} else {
-			printf("FALSE");
+			sk_output_write(env->out, "FALSE", 5);
 		}
 		break;
 	default:
@@ -93,217 +137,412 @@ SK_INTRINSIC skI_print (skE *env)
 		longjmp(env->jmp, 1);
 	}
 
-	fflush(stdout);
 	skO_free(obj);
 
 	return NULL;
 }
 
+/*
+Push the runtime counters as a list of `[:name value]' pairs.
+*/
+SK_INTRINSIC skI_stats (skE *env)
+{
+	sk_stat stats[SK_STATS_MAX];
+	size_t  count = sk_stats_collect(stats);
+	size_t  i;
+	skO     *list = skO_list_new();
+	skO     *pair;
+
+	for (i = 0; i < count; i++) {
+		pair = skO_list_new();
+		sk_list_append(pair, skO_quoted_symbol_new(stats[i].name));
+		sk_list_append(pair, skO_integer_new(stats[i].value));
+		sk_list_append(list, pair);
+	}
+
+	skE_stackPush(env, list);
+
+	return NULL;
+}
+
+SK_INTRINSIC skI_flush (skE *env)
+{
+	sk_output_flush(env->out);
+
+	return NULL;
+}
+
+/*
+Input intrinsics push `:$eof' instead of a character or a string once the
+end of input is reached.
+*/
+void push_eof (skE *env)
+{
+	skE_stackPush(env, skO_quoted_symbol_new("$eof"));
+}
+
 SK_INTRINSIC skI_getc (skE *env)
 {
-	skE_stackPush(env, skO_character_new(fgetc(stdin)));
+	int c = sk_input_getc(env->in);
+
+	if (c == EOF)
+		push_eof(env);
+	else
+		skE_stackPush(env, skO_character_new(c));
+
+	return NULL;
+}
+
+SK_INTRINSIC skI_read_line (skE *env)
+{
+	skO *line = sk_input_line(env->in);
+
+	if (line)
+		skE_stackPush(env, line);
+	else
+		push_eof(env);
+
+	return NULL;
+}
+
+SK_INTRINSIC skI_read_all (skE *env)
+{
+	skO *all = sk_input_read(env->in, (size_t)-1);
+
+	if (all)
+		skE_stackPush(env, all);
+	else
+		push_eof(env);
 
 	return NULL;
 }
 
+/*
+Sizes of at most 0 read nothing, and sizes beyond the largest `size_t' read
+the rest of the input, like `read-all'.
+*/
+SK_INTRINSIC skI_read_chunk (skE *env)
+{
+	skV    n = skE_stackPopValue(env);
+	double size;
+	skO    *chunk;
+
+	skV_checkType(&n, SKO_NUMBER);
+	size = skV_double(n);
+
+	if (size != floor(size)) {
+		fprintf(stderr, "PANIC! Chunk size is not an integer: %g.\n", size);
+		longjmp(env->jmp, 1);
+	}
+
+	if (size <= 0)
+		chunk = skO_string_new(NULL, 0);
+	else if (size < (double)(size_t)-1)
+		chunk = sk_input_read(env->in, (size_t)size);
+	else
+		chunk = sk_input_read(env->in, (size_t)-1);
+
+	if (chunk)
+		skE_stackPush(env, chunk);
+	else
+		push_eof(env);
+
+	return NULL;
+}
+
+void push_boolean (skE *env, int b)
+{
+	skV v;
+
+	v.tag          = SKO_BOOLEAN;
+	v.data.boolean = b;
+	skE_stackPushValue(env, v);
+}
+
 SK_INTRINSIC skI_true (skE *env)
 {
-	skE_stackPush(env, skO_boolean_new(1));
+	push_boolean(env, 1);
 
 	return NULL;
 }
 
 SK_INTRINSIC skI_false (skE *env)
 {
-	skE_stackPush(env, skO_boolean_new(0));
+	push_boolean(env, 0);
 
 	return NULL;
 }
 
+/*
+Arithmetic on two integers is exact as long as the result fits in a `long
+long'. In any other case, the operands are converted to floating point.
+*/
+
+#define INTEGERS(l, r) ((l).tag == SKO_INTEGER && (r).tag == SKO_INTEGER)
+
+void set_number (skV *v, double d)
+{
+	v->tag         = SKO_NUMBER;
+	v->data.number = d;
+}
+
+int add_overflows (long long a, long long b)
+{
+	return (b > 0 && a > LLONG_MAX - b) || (b < 0 && a < LLONG_MIN - b);
+}
+
+int sub_overflows (long long a, long long b)
+{
+	return (b < 0 && a > LLONG_MAX + b) || (b > 0 && a < LLONG_MIN + b);
+}
+
+int mul_overflows (long long a, long long b)
+{
+	if (a == 0 || b == 0)
+		return 0;
+	if (a == -1)
+		return b == LLONG_MIN;
+	if (b == -1)
+		return a == LLONG_MIN;
+	if (a > 0)
+		return b > 0 ? a > LLONG_MAX / b : b < LLONG_MIN / a;
+	return b > 0 ? a < LLONG_MIN / b : a < LLONG_MAX / b;
+}
+
+/*
+Raise `base' to a non-negative power. Return 0 if the result overflows.
+*/
+int integer_pow (long long base, long long exp, long long *result)
+{
+	long long r = 1;
+
+	while (exp) {
+		if (exp & 1) {
+			if (mul_overflows(r, base))
+				return 0;
+			r *= base;
+		}
+		exp >>= 1;
+		if (exp) {
+			if (mul_overflows(base, base))
+				return 0;
+			base *= base;
+		}
+	}
+
+	*result = r;
+	return 1;
+}
+
 SK_INTRINSIC skI_add (skE *env)
 {
-	skO *r = skE_stackPop(env);
-	skO *l = skE_stackPop(env);
+	skV r = skE_stackPopValue(env);
+	skV l = skE_stackPopValue(env);
 
-	skO_checkType(r, SKO_NUMBER);
-	skO_checkType(l, SKO_NUMBER);
+	skV_checkType(&r, SKO_NUMBER);
+	skV_checkType(&l, SKO_NUMBER);
 
-	l->data.number = l->data.number + r->data.number;
+	if (INTEGERS(l, r) && !add_overflows(l.data.integer, r.data.integer))
+		l.data.integer = l.data.integer + r.data.integer;
+	else
+		set_number(&l, skV_double(l) + skV_double(r));
 
-	skO_free(r);
-	skE_stackPush(env, l);
+	skE_stackPushValue(env, l);
 
 	return NULL;
 }
 
 SK_INTRINSIC skI_sub (skE *env)
 {
-	skO *r = skE_stackPop(env);
-	skO *l = skE_stackPop(env);
+	skV r = skE_stackPopValue(env);
+	skV l = skE_stackPopValue(env);
 
-	skO_checkType(r, SKO_NUMBER);
-	skO_checkType(l, SKO_NUMBER);
+	skV_checkType(&r, SKO_NUMBER);
+	skV_checkType(&l, SKO_NUMBER);
 
-	l->data.number = l->data.number - r->data.number;
+	if (INTEGERS(l, r) && !sub_overflows(l.data.integer, r.data.integer))
+		l.data.integer = l.data.integer - r.data.integer;
+	else
+		set_number(&l, skV_double(l) - skV_double(r));
 
-	skO_free(r);
-	skE_stackPush(env, l);
+	skE_stackPushValue(env, l);
 
 	return NULL;
 }
 
 SK_INTRINSIC skI_mul (skE *env)
 {
-	skO *r = skE_stackPop(env);
-	skO *l = skE_stackPop(env);
+	skV r = skE_stackPopValue(env);
+	skV l = skE_stackPopValue(env);
 
-	skO_checkType(r, SKO_NUMBER);
-	skO_checkType(l, SKO_NUMBER);
+	skV_checkType(&r, SKO_NUMBER);
+	skV_checkType(&l, SKO_NUMBER);
 
-	l->data.number = l->data.number * r->data.number;
+	if (INTEGERS(l, r) && !mul_overflows(l.data.integer, r.data.integer))
+		l.data.integer = l.data.integer * r.data.integer;
+	else
+		set_number(&l, skV_double(l) * skV_double(r));
 
-	skO_free(r);
-	skE_stackPush(env, l);
+	skE_stackPushValue(env, l);
 
 	return NULL;
 }
 
 SK_INTRINSIC skI_div (skE *env)
 {
-	skO *r = skE_stackPop(env);
-	skO *l = skE_stackPop(env);
+	skV r = skE_stackPopValue(env);
+	skV l = skE_stackPopValue(env);
 
-	skO_checkType(r, SKO_NUMBER);
-	skO_checkType(l, SKO_NUMBER);
+	skV_checkType(&r, SKO_NUMBER);
+	skV_checkType(&l, SKO_NUMBER);
 
-	l->data.number = l->data.number / r->data.number;
+	/* The quotient of two integers is an integer only if it is exact. */
+	if (INTEGERS(l, r) && r.data.integer != 0
+		&& !(r.data.integer == -1 && l.data.integer == LLONG_MIN)
+		&& l.data.integer % r.data.integer == 0)
+		l.data.integer = l.data.integer / r.data.integer;
+	else
+		set_number(&l, skV_double(l) / skV_double(r));
 
-	skO_free(r);
-	skE_stackPush(env, l);
+	skE_stackPushValue(env, l);
 
 	return NULL;
 }
 
 SK_INTRINSIC skI_pow (skE *env)
 {
-	skO *r = skE_stackPop(env);
-	skO *l = skE_stackPop(env);
+	skV       r = skE_stackPopValue(env);
+	skV       l = skE_stackPopValue(env);
+	long long result;
 
-	skO_checkType(r, SKO_NUMBER);
-	skO_checkType(l, SKO_NUMBER);
+	skV_checkType(&r, SKO_NUMBER);
+	skV_checkType(&l, SKO_NUMBER);
 
-	l->data.number = pow(l->data.number, r->data.number);
+	if (INTEGERS(l, r) && r.data.integer >= 0
+		&& integer_pow(l.data.integer, r.data.integer, &result))
+		l.data.integer = result;
+	else
+		set_number(&l, pow(skV_double(l), skV_double(r)));
 
-	skO_free(r);
-	skE_stackPush(env, l);
+	skE_stackPushValue(env, l);
 
 	return NULL;
 }
 
 SK_INTRINSIC skI_mod (skE *env)
 {
-	skO *r = skE_stackPop(env);
-	skO *l = skE_stackPop(env);
+	skV r = skE_stackPopValue(env);
+	skV l = skE_stackPopValue(env);
 
-	skO_checkType(r, SKO_NUMBER);
-	skO_checkType(l, SKO_NUMBER);
+	skV_checkType(&r, SKO_NUMBER);
+	skV_checkType(&l, SKO_NUMBER);
 
-	l->data.number = fmod(l->data.number, r->data.number);
+	/* Like `fmod', the result has the sign of the dividend. */
+	if (INTEGERS(l, r) && r.data.integer != 0)
+		l.data.integer = r.data.integer == -1
+			? 0 : l.data.integer % r.data.integer;
+	else
+		set_number(&l, fmod(skV_double(l), skV_double(r)));
 
-	skO_free(r);
-	skE_stackPush(env, l);
+	skE_stackPushValue(env, l);
 
 	return NULL;
 }
 
 SK_INTRINSIC skI_abs (skE *env)
 {
-	skO *l = skE_stackPop(env);
+	skV l = skE_stackPopValue(env);
 
-	skO_checkType(l, SKO_NUMBER);
+	skV_checkType(&l, SKO_NUMBER);
 
-	l->data.number = fabs(l->data.number);
+	if (l.tag == SKO_INTEGER && l.data.integer != LLONG_MIN)
+		l.data.integer = l.data.integer < 0
+			? -l.data.integer : l.data.integer;
+	else
+		set_number(&l, fabs(skV_double(l)));
 
-	skE_stackPush(env, l);
+	skE_stackPushValue(env, l);
 
 	return NULL;
 }
 
 SK_INTRINSIC skI_gt (skE *env)
 {
-	skO *r = skE_stackPop(env);
-	skO *l = skE_stackPop(env);
+	skV r = skE_stackPopValue(env);
+	skV l = skE_stackPopValue(env);
 
-	skO_checkType(r, SKO_NUMBER);
-	skO_checkType(l, SKO_NUMBER);
+	skV_checkType(&r, SKO_NUMBER);
+	skV_checkType(&l, SKO_NUMBER);
 
-	l->data.boolean = l->data.number > r->data.number;
-	l->tag = SKO_BOOLEAN;
+	if (INTEGERS(l, r))
+		l.data.boolean = l.data.integer > r.data.integer;
+	else
+		l.data.boolean = skV_double(l) > skV_double(r);
+	l.tag = SKO_BOOLEAN;
 
-	skO_free(r);
-	skE_stackPush(env, l);
+	skE_stackPushValue(env, l);
 
 	return NULL;
 }
 
 SK_INTRINSIC skI_lt (skE *env)
 {
-	skO *r = skE_stackPop(env);
-	skO *l = skE_stackPop(env);
+	skV r = skE_stackPopValue(env);
+	skV l = skE_stackPopValue(env);
 
-	skO_checkType(r, SKO_NUMBER);
-	skO_checkType(l, SKO_NUMBER);
+	skV_checkType(&r, SKO_NUMBER);
+	skV_checkType(&l, SKO_NUMBER);
 
-	l->data.boolean = l->data.number < r->data.number;
-	l->tag = SKO_BOOLEAN;
+	if (INTEGERS(l, r))
+		l.data.boolean = l.data.integer < r.data.integer;
+	else
+		l.data.boolean = skV_double(l) < skV_double(r);
+	l.tag = SKO_BOOLEAN;
 
-	skO_free(r);
-	skE_stackPush(env, l);
+	skE_stackPushValue(env, l);
 
 	return NULL;
 }
 
 SK_INTRINSIC skI_and (skE *env)
 {
-	skO *r = skE_stackPop(env);
-	skO *l = skE_stackPop(env);
+	skV r = skE_stackPopValue(env);
+	skV l = skE_stackPopValue(env);
 
-	skO_checkType(r, SKO_BOOLEAN);
-	skO_checkType(l, SKO_BOOLEAN);
+	skV_checkType(&r, SKO_BOOLEAN);
+	skV_checkType(&l, SKO_BOOLEAN);
 
-	l->data.boolean = l->data.boolean && r->data.boolean;
+	l.data.boolean = l.data.boolean && r.data.boolean;
 
-	skO_free(r);
-	skE_stackPush(env, l);
+	skE_stackPushValue(env, l);
 
 	return NULL;
 }
 
 SK_INTRINSIC skI_or (skE *env)
 {
-	skO *r = skE_stackPop(env);
-	skO *l = skE_stackPop(env);
+	skV r = skE_stackPopValue(env);
+	skV l = skE_stackPopValue(env);
 
-	skO_checkType(r, SKO_BOOLEAN);
-	skO_checkType(l, SKO_BOOLEAN);
+	skV_checkType(&r, SKO_BOOLEAN);
+	skV_checkType(&l, SKO_BOOLEAN);
 
-	l->data.boolean = l->data.boolean || r->data.boolean;
+	l.data.boolean = l.data.boolean || r.data.boolean;
 
-	skO_free(r);
-	skE_stackPush(env, l);
+	skE_stackPushValue(env, l);
 
 	return NULL;
 }
 
 SK_INTRINSIC skI_not (skE *env)
 {
-	skO *l = skE_stackPop(env);
+	skV l = skE_stackPopValue(env);
 
-	skO_checkType(l, SKO_BOOLEAN);
+	skV_checkType(&l, SKO_BOOLEAN);
 
-	l->data.boolean = !l->data.boolean;
+	l.data.boolean = !l.data.boolean;
 
-	skE_stackPush(env, l);
+	skE_stackPushValue(env, l);
 
 	return NULL;
 }
@@ -311,7 +550,7 @@ SK_INTRINSIC skI_not (skE *env)
 SK_INTRINSIC skI_exec (skE *env)
 {
 	skO *list = skE_stackPop(env);
-	skO_checkType(list, SKO_LIST);
+	skO_checkList(list);
 
 	return list;
 }
@@ -320,30 +559,10 @@ SK_INTRINSIC skI_parse (skE *env)
 {
 	char    *cursor;
 	char    *str;
-	skO     *node;
 	skO     *list = skE_stackPop(env);
-	int     count = 1; /* string will be 0 terminated */
-	int     i     = 0;
 	jmp_buf jmp;
 
-	skO_checkType(list, SKO_LIST);
-
-	node = list->data.list;
-	while (node) {
-		count++;
-		node = node->next;
-	}
-
-	str = malloc(count);
-
-	node = list->data.list;
-	while (node) {
-		str[i] = node->data.character;
-		i++;
-		node = node->next;
-	}
-	str[i] = 0;
-
+	str    = sk_string_cstring(list);
 	cursor = str;
 
 	if (setjmp(jmp)) {
@@ -366,7 +585,7 @@ SK_INTRINSIC skI_exec_if (skE *env)
 	skO *list = skE_stackPop(env);
 	skO *b    = skE_stackPop(env);
 
-	skO_checkType(list, SKO_LIST);
+	skO_checkList(list);
 	skO_checkType(b, SKO_BOOLEAN);
 
 	if (b->data.boolean) {
@@ -380,81 +599,451 @@ SK_INTRINSIC skI_exec_if (skE *env)
 	return list;
 }
 
-int skO_eql (skO *l, skO *r)
+/*
+Compare a string with a list by content: they are equal if the list holds the
+same characters.
+*/
+int string_eql_list (skO *str, skO *list)
 {
-	skO *ln;
-	skO *rn;
+	skO    *node = list->data.list;
+	size_t i;
 
-	if (l->tag == r->tag) {
-		switch (l->tag) {
-		case SKO_LIST:
-			ln = l->data.list;
-			rn = r->data.list;
+	if (str->length != list->length)
+		return 0;
 
-			while (ln && rn) {
-				if (!skO_eql(ln, rn))
-					return 0;
+	for (i = 0; i < str->length; i++) {
+		if (node->tag != SKO_CHARACTER
+			|| node->data.character != str->data.string[i])
+			return 0;
+		node = node->next;
+	}
 
-				ln = ln->next;
-				rn = rn->next;
-			}
+	return 1;
+}
 
-			if ((!ln && rn) || (ln && !rn)) {
-				return 0;
-			} else {
-				return 1;
-			}
-		case SKO_CHARACTER:
-			if (l->data.character == r->data.character)
-				return 1;
-		case SKO_BOOLEAN:
-			if (l->data.boolean == r->data.boolean)
-				return 1;
-		case SKO_SYMBOL:
-		case SKO_QSYMBOL:
-			if (l->data.sym == r->data.sym)
-				return 1;
-		case SKO_NUMBER:
-			if (l->data.number == r->data.number)
-				return 1;
-		default:
+/*
+An integer and a floating point number are equal only if they denote exactly
+the same value: converting the integer alone could round it.
+*/
+int integer_eql_number (long long i, double d)
+{
+	return d == (double)i && d >= -9223372036854775808.0
+		&& d < 9223372036854775808.0 && (long long)d == i;
+}
+
+/*
+Compare two objects which are not both lists. In strict mode (see `skV_eql'),
+objects of different tags are different, and numbers are compared bit for bit.
+*/
+int atom_eql (skO *l, skO *r, int strict)
+{
+	if (strict) {
+		if (l->tag != r->tag)
 			return 0;
-		}
-	} else {
+		if (l->tag == SKO_NUMBER)
+			return !memcmp(&l->data.number, &r->data.number, sizeof(double));
+	}
+
+	if (l->tag == SKO_STRING && r->tag == SKO_LIST)
+		return string_eql_list(l, r);
+	if (l->tag == SKO_LIST && r->tag == SKO_STRING)
+		return string_eql_list(r, l);
+
+	if (l->tag == SKO_INTEGER && r->tag == SKO_NUMBER)
+		return integer_eql_number(l->data.integer, r->data.number);
+	if (l->tag == SKO_NUMBER && r->tag == SKO_INTEGER)
+		return integer_eql_number(r->data.integer, l->data.number);
+
+	if (l->tag != r->tag)
+		return 0;
+
+	switch (l->tag) {
+	case SKO_STRING:
+		return l->length == r->length && (!l->length
+			|| !memcmp(l->data.string, r->data.string, l->length));
+	case SKO_CHARACTER:
+		return l->data.character == r->data.character;
+	case SKO_BOOLEAN:
+		return !l->data.boolean == !r->data.boolean;
+	case SKO_SYMBOL:
+	case SKO_QSYMBOL:
+		return l->data.sym == r->data.sym;
+	case SKO_NUMBER:
+		return l->data.number == r->data.number;
+	case SKO_INTEGER:
+		return l->data.integer == r->data.integer;
+	default:
 		return 0;
 	}
 }
 
-SK_INTRINSIC skI_eql (skE *env)
+/*
+Lists are compared and hashed without recursion: the positions reached in
+the lists are kept in an array, which only grows with the nesting of the
+lists. Lists of different lengths, or whose hashes are known and differ, are
+told apart without looking at their elements.
+*/
+#define EQL_DEPTH 32
+
+/*
+Double the `capacity' of the array of positions `pos', of `size' bytes each,
+which starts as the array `local' of `EQL_DEPTH' positions.
+*/
+void *positions_grow (void *pos, void *local, size_t *capacity, size_t size)
 {
-	skO *r = skE_stackPop(env);
-	skO *l = skE_stackPop(env);
+	*capacity *= 2;
 
-	if (skO_eql(l, r)) {
-		skE_stackPush(env, skO_boolean_new(1));
+	if (pos == local) {
+		pos = malloc(*capacity * size);
+		if (pos)
+			memcpy(pos, local, EQL_DEPTH * size);
 	} else {
-		skE_stackPush(env, skO_boolean_new(0));
+		pos = realloc(pos, *capacity * size);
 	}
 
-	skO_free(l);
-	skO_free(r);
+	if (!pos)
+		FATAL("INTERPRETER ERROR! Out of memory.\n");
+
+	return pos;
+}
+
+int lists_differ (skO *l, skO *r)
+{
+	return l->length != r->length
+		|| (l->hash && r->hash && l->hash != r->hash);
+}
+
+typedef struct {
+	skO *l;
+	skO *r;
+} eql_position;
+
+int objects_eql (skO *l, skO *r, int strict)
+{
+	eql_position  local[EQL_DEPTH];
+	eql_position  *pos      = local;
+	size_t        depth     = 0;
+	size_t        capacity  = EQL_DEPTH;
+	int           eql       = 1;
+
+	if (l == r)
+		return 1;
+	if (l->tag != SKO_LIST || r->tag != SKO_LIST)
+		return atom_eql(l, r, strict);
+	if (lists_differ(l, r))
+		return 0;
+
+	pos[depth].l   = l->data.list;
+	pos[depth++].r = r->data.list;
+
+	while (depth && eql) {
+		l = pos[depth - 1].l;
+		r = pos[depth - 1].r;
+
+		/* Both lists have the same length, and end together. */
+		if (!l) {
+			depth--;
+			continue;
+		}
+
+		pos[depth - 1].l = l->next;
+		pos[depth - 1].r = r->next;
+
+		if (l->tag != SKO_LIST || r->tag != SKO_LIST) {
+			eql = atom_eql(l, r, strict);
+		} else if (lists_differ(l, r)) {
+			eql = 0;
+		} else if (l->data.list) {
+			if (depth == capacity)
+				pos = positions_grow(pos, local, &capacity,
+					sizeof(eql_position));
+			pos[depth].l   = l->data.list;
+			pos[depth++].r = r->data.list;
+		}
+	}
+
+	if (pos != local)
+		free(pos);
+
+	return eql;
+}
+
+int skO_eql (skO *l, skO *r)
+{
+	return objects_eql(l, r, 0);
+}
+
+/*
+Hashes agree with `skO_eql': objects which are equal have the same hash.
+Numbers holding an integral value hash like the integer, and strings hash
+like the list of their characters.
+*/
+
+/* FNV-1a */
+#define HASH_SEED       2166136261UL
+#define HASH_STEP(h, x) (((h) ^ (unsigned long)(x)) * 16777619UL)
+
+/* Hash 64 bits, 32 at a time. */
+unsigned long hash_word (unsigned long h, unsigned long long w)
+{
+	h = HASH_STEP(h, w & 0xffffffffUL);
+	return HASH_STEP(h, w >> 32);
+}
+
+unsigned long hash_integer (long long i)
+{
+	return hash_word(HASH_STEP(HASH_SEED, SKO_INTEGER), i);
+}
+
+unsigned long hash_character (char c)
+{
+	return HASH_STEP(HASH_STEP(HASH_SEED, SKO_CHARACTER), (unsigned char)c);
+}
+
+/*
+Last step of the hash of a list or string of `length' elements. It is never
+0, which marks the lists whose hash is not known.
+*/
+unsigned long hash_end (unsigned long h, size_t length)
+{
+	h = HASH_STEP(HASH_STEP(h, SKO_LIST), length);
+	return h ? h : 1;
+}
+
+/*
+Hash of a value which is not a list.
+*/
+unsigned long atom_hash (skV v)
+{
+	unsigned long      h = HASH_SEED;
+	unsigned long long bits;
+	size_t             i;
+
+	switch (v.tag) {
+	case SKO_INTEGER:
+		return hash_integer(v.data.integer);
+	case SKO_NUMBER:
+		if (v.data.number >= -9223372036854775808.0
+			&& v.data.number < 9223372036854775808.0
+			&& (double)(long long)v.data.number == v.data.number)
+			return hash_integer((long long)v.data.number);
+		memcpy(&bits, &v.data.number, sizeof(double));
+		return hash_word(HASH_STEP(h, SKO_NUMBER), bits);
+	case SKO_CHARACTER:
+		return hash_character(v.data.character);
+	case SKO_BOOLEAN:
+		return HASH_STEP(HASH_STEP(h, SKO_BOOLEAN), !!v.data.boolean);
+	case SKO_SYMBOL:
+	case SKO_QSYMBOL:
+		return hash_word(HASH_STEP(h, v.tag), (size_t)v.data.sym);
+	case SKO_STRING:
+		for (i = 0; i < v.data.obj->length; i++)
+			h = HASH_STEP(h * 31, hash_character(v.data.obj->data.string[i]));
+		return hash_end(h, v.data.obj->length);
+	default:
+		return h;
+	}
+}
+
+typedef struct {
+	skO           *list;
+	skO           *node; /* next element to hash */
+	unsigned long h;
+} hash_position;
+
+/*
+Hash `list', and keep the hash of each list reached in it.
+*/
+unsigned long list_hash (skO *list)
+{
+	hash_position local[EQL_DEPTH];
+	hash_position *pos     = local;
+	size_t        depth    = 0;
+	size_t        capacity = EQL_DEPTH;
+	unsigned long h;
+	skO           *node;
+
+	if (list->hash)
+		return list->hash;
+
+	pos[depth].list = list;
+	pos[depth].node = list->data.list;
+	pos[depth++].h  = HASH_SEED;
+
+	while (depth) {
+		node = pos[depth - 1].node;
+
+		if (!node) {
+			h = hash_end(pos[depth - 1].h, pos[depth - 1].list->length);
+			pos[depth - 1].list->hash = h;
+			if (--depth)
+				pos[depth - 1].h = HASH_STEP(pos[depth - 1].h * 31, h);
+			continue;
+		}
+
+		pos[depth - 1].node = node->next;
+
+		if (node->tag == SKO_LIST && !node->hash) {
+			if (depth == capacity)
+				pos = positions_grow(pos, local, &capacity,
+					sizeof(hash_position));
+			pos[depth].list = node;
+			pos[depth].node = node->data.list;
+			pos[depth++].h  = HASH_SEED;
+			continue;
+		}
+
+		h = node->tag == SKO_LIST ? node->hash : atom_hash(skV_of(node));
+		pos[depth - 1].h = HASH_STEP(pos[depth - 1].h * 31, h);
+	}
+
+	if (pos != local)
+		free(pos);
+
+	return list->hash;
+}
+
+unsigned long skV_hash (skV v)
+{
+	if (v.tag == SKO_LIST)
+		return list_hash(v.data.obj);
+
+	return atom_hash(v);
+}
+
+unsigned long skO_hash (skO *obj)
+{
+	return skV_hash(skV_of(obj));
+}
+
+/*
+Compare two scalar values, without boxing them.
+*/
+int scalar_eql (skV l, skV r, int strict)
+{
+	if (strict) {
+		if (l.tag != r.tag)
+			return 0;
+		if (l.tag == SKO_NUMBER)
+			return !memcmp(&l.data.number, &r.data.number, sizeof(double));
+	}
+
+	if (l.tag == SKO_INTEGER && r.tag == SKO_NUMBER)
+		return integer_eql_number(l.data.integer, r.data.number);
+	if (l.tag == SKO_NUMBER && r.tag == SKO_INTEGER)
+		return integer_eql_number(r.data.integer, l.data.number);
+	if (l.tag != r.tag)
+		return 0;
+
+	switch (l.tag) {
+	case SKO_NUMBER:
+		return l.data.number == r.data.number;
+	case SKO_INTEGER:
+		return l.data.integer == r.data.integer;
+	case SKO_BOOLEAN:
+		return !l.data.boolean == !r.data.boolean;
+	case SKO_CHARACTER:
+		return l.data.character == r.data.character;
+	default:
+		return l.data.sym == r.data.sym;
+	}
+}
+
+/*
+A scalar is never equal to a list or a string, so values are compared
+without boxing them.
+*/
+int skV_eql (skV l, skV r, int strict)
+{
+	if (SKV_BOXED(l.tag) && SKV_BOXED(r.tag))
+		return objects_eql(l.data.obj, r.data.obj, strict);
+	if (SKV_BOXED(l.tag) || SKV_BOXED(r.tag))
+		return 0;
+
+	return scalar_eql(l, r, strict);
+}
+
+SK_INTRINSIC skI_eql (skE *env)
+{
+	skV r   = skE_stackPopValue(env);
+	skV l   = skE_stackPopValue(env);
+	int eql = skV_eql(l, r, 0);
+
+	if (SKV_BOXED(l.tag))
+		skO_free(l.data.obj);
+	if (SKV_BOXED(r.tag))
+		skO_free(r.data.obj);
+
+	push_boolean(env, eql);
 
 	return NULL;
 }
 
+SK_INTRINSIC skI_hash (skE *env)
+{
+	skV v = skE_stackPopValue(env);
+	skV h;
+
+	h.tag          = SKO_INTEGER;
+	h.data.integer = skV_hash(v) & LLONG_MAX;
+
+	if (SKV_BOXED(v.tag))
+		skO_free(v.data.obj);
+
+	skE_stackPushValue(env, h);
+
+	return NULL;
+}
+
+/*
+Fast path of the `SKC_OPERAND' superinstruction: apply the arithmetic or
+comparison intrinsic `native' to the integer on top of the stack and `k', in
+place. Return 0, leaving the stack untouched, if the intrinsic would not
+take its integer path.
+*/
+int integer_operand (skE *env, skE_natOp *native, long long k)
+{
+	skV       *top;
+	long long n;
+
+	if (!env->depth || env->stack[env->depth - 1].tag != SKO_INTEGER)
+		return 0;
+
+	top = &env->stack[env->depth - 1];
+	n   = top->data.integer;
+	SKE_TOUCH(env, env->depth - 1);
+
+	if (native == &skI_add && !add_overflows(n, k)) {
+		top->data.integer = n + k;
+	} else if (native == &skI_sub && !sub_overflows(n, k)) {
+		top->data.integer = n - k;
+	} else if (native == &skI_mul && !mul_overflows(n, k)) {
+		top->data.integer = n * k;
+	} else if (native == &skI_eql) {
+		top->tag          = SKO_BOOLEAN;
+		top->data.boolean = n == k;
+	} else if (native == &skI_lt) {
+		top->tag          = SKO_BOOLEAN;
+		top->data.boolean = n < k;
+	} else if (native == &skI_gt) {
+		top->tag          = SKO_BOOLEAN;
+		top->data.boolean = n > k;
+	} else {
+		return 0;
+	}
+
+	return 1;
+}
+
 SK_INTRINSIC skI_length (skE *env)
 {
-	size_t len = 0;
 	skO *list = skE_stackPop(env);
-	skO *node = list->data.list;
 
-	while (node) {
-		len++;
-		node = node->next;
-	}
+	if (list->tag != SKO_STRING)
+		skO_checkType(list, SKO_LIST);
 
 	skE_stackPush(env, list);
-	skE_stackPush(env, skO_number_new(len));
+	skE_stackPush(env, skO_integer_new(list->length));
 
 	return NULL;
 }
@@ -464,8 +1053,7 @@ SK_INTRINSIC skI_cons (skE *env)
 	skO *obj  = skE_stackPop(env);
 	skO *list = skE_stackPop(env);
 
-	obj->next = list->data.list;
-	list->data.list = obj;
+	sk_list_cons(list, obj);
 
 	skE_stackPush(env, list);
 
@@ -477,9 +1065,11 @@ SK_INTRINSIC skI_uncons (skE *env)
 	skO *obj;
 	skO *list = skE_stackPop(env);
 
-	obj = list->data.list;
-	list->data.list = obj->next;
-	obj->next = NULL;
+	obj = sk_list_uncons(list);
+	if (!obj) {
+		fprintf(stderr, "PANIC! Tried to uncons an empty list.\n");
+		longjmp(env->jmp, 1);
+	}
 
 	skE_stackPush(env, list);
 	skE_stackPush(env, obj);
@@ -487,25 +1077,50 @@ SK_INTRINSIC skI_uncons (skE *env)
 	return NULL;
 }
 
+SK_INTRINSIC skI_list_to_string (skE *env)
+{
+	skO  *list = skE_stackPop(env);
+	skO  *node;
+	char *str;
+
+	if (list->tag == SKO_STRING) {
+		skE_stackPush(env, list);
+		return NULL;
+	}
+
+	skO_checkType(list, SKO_LIST);
+	for (node = list->data.list; node; node = node->next)
+		skO_checkType(node, SKO_CHARACTER);
+
+	str = sk_string_cstring(list);
+	skE_stackPush(env, skO_string_new(str, list->length));
+
+	free(str);
+	skO_free(list);
+
+	return NULL;
+}
+
+SK_INTRINSIC skI_string_to_list (skE *env)
+{
+	skO *str = skE_stackPop(env);
+
+	skO_checkList(str);
+	skE_stackPush(env, str);
+
+	return NULL;
+}
+
 SK_INTRINSIC skI_with (skE *env)
 {
-	char buffer[256];
-	int i = 0;
+	char *buffer;
 	skO *ast;
-	skO *skchar;
 	skO *fname = skE_stackPop(env);
 
-	skO_checkType(fname, SKO_LIST);
-	skchar = fname->data.list;
-
-	while (skchar) {
-		buffer[i] = skchar->data.character;
-		skchar = skchar->next;
-		i++;
-	}
-	buffer[i] = 0;
+	buffer = sk_string_cstring(fname);
 
 	ast = skO_loadParse(buffer);
+	free(buffer);
 	skO_free(fname);
 
 	skE_execList(env, ast, 0);
@@ -526,6 +1141,7 @@ SK_INTRINSIC skI_type (skE *env)
 		sym = skO_symbol_new("Symbol");
 		break;
 	case SKO_NUMBER:
+	case SKO_INTEGER:
 		sym = skO_symbol_new("Number");
 		break;
 	case SKO_CHARACTER:
@@ -534,6 +1150,9 @@ SK_INTRINSIC skI_type (skE *env)
 	case SKO_LIST:
 		sym = skO_symbol_new("List");
 		break;
+	case SKO_STRING:
+		sym = skO_symbol_new("String");
+		break;
 	case SKO_BOOLEAN:
 		sym = skO_symbol_new("Boolean");
 		break;
@@ -552,6 +1171,11 @@ SK_INTRINSIC skI_type (skE *env)
 SK_INTRINSIC skI_quote (skE *env)
 {
 	skO *sym = skE_stackPop(env);
+
+	/* Only symbols can be retagged in place. */
+	if (sym->tag != SKO_QSYMBOL)
+		skO_checkType(sym, SKO_SYMBOL);
+
 	sym->tag = SKO_QSYMBOL;
 	skE_stackPush(env, sym);
 
@@ -561,6 +1185,10 @@ SK_INTRINSIC skI_quote (skE *env)
 SK_INTRINSIC skI_unquote (skE *env)
 {
 	skO *sym = skE_stackPop(env);
+
+	if (sym->tag != SKO_SYMBOL)
+		skO_checkType(sym, SKO_QSYMBOL);
+
 	sym->tag = SKO_SYMBOL;
 	skE_stackPush(env, sym);
 
@@ -572,25 +1200,488 @@ SK_INTRINSIC skI_try (skE *env)
 	skO *action = skE_stackPop(env);
 	skE *local  = skE_new();
 	skO *result;
+	#ifdef SK_PROFILE
+	size_t depth = sk_profile_depth();
+	#endif
 
-	skO_checkType(action, SKO_LIST);
+	skO_checkList(action);
 
 	local->scope = env->scope;
-	local->stack = NULL;
+	local->out   = env->out;
+	local->in    = env->in;
+	local->flags = env->flags;
 
 	if (setjmp(local->jmp)) {
+		/* Scopes pushed by the action are abandoned without being popped. */
+		sk_symbol_invalidate();
+		#ifdef SK_PROFILE
+		sk_profile_unwind(depth);
+		#endif
 		skE_stackPush(env, skO_quoted_symbol_new("$try/failed"));
 	} else {
 		skE_execList(local, action, 1);
 		result = skO_list_new();
-		result->data.list = local->stack;
-		local->stack = NULL;
+		while (local->depth)
+			sk_list_append(result, skE_stackPop(local));
 		skE_stackPush(env, result);
 		skE_stackPush(env, skO_quoted_symbol_new("$try/ok"));
 	}
 
 	local->scope = NULL;
+	local->out   = NULL;
+	local->in    = NULL;
 	skE_scopePush(local);
 	skE_free(local);
 	return NULL;
 }
+
+/*////////////////////////////////////////////////////////////////////////////
+//                           CONTROL COMBINATORS                            //
+////////////////////////////////////////////////////////////////////////////*/
+
+/*
+These intrinsics replace the definitions of `lib/combinators.shk', which are
+used instead when the environment has the `SKE_SHIRKA_PRELUDE' flag.
+They behave the same way: each run of a list happens in a new scope, and the
+objects the Shirka versions keep on the stack while running a list (the
+accumulator of `map' and `filter') are kept there too. `map' and `filter'
+build their results with the `cons' and `reverse' of the current scope, which
+are only the intrinsics as long as they are not redefined.
+
+Lists run repeatedly are compiled once for the whole loop. Since they are
+compiled again at each run of the combinator, constants are not folded.
+
+The lists and code of a loop are held in a `loop' and released by
+`loop_close', whether the loop ends or fails.
+*/
+
+typedef struct {
+	skO      *list;
+	skC_code *code;
+} loop_body;
+
+typedef struct {
+	loop_body op;
+	loop_body cond;   /* condition of `while'                  */
+	skO       *list;  /* list iterated over                    */
+	skO       *held;  /* element `filter' keeps during a test  */
+	double    runs;   /* runs left, for `times'                */
+} loop;
+
+typedef void (loop_fn)(skE *env, loop *l);
+
+void body_open (skE *env, loop_body *body, skO *list)
+{
+	skO_checkList(list);
+
+	body->list = list;
+	body->code = NULL;
+
+	if (!(env->flags & SKE_NO_COMPILE))
+		body->code = skC_compile(NULL, list);
+}
+
+void body_run (skE *env, loop_body *body)
+{
+	exec(env, body->list->data.list, body->code, 0, 1);
+}
+
+void body_close (loop_body *body)
+{
+	if (body->code)
+		skC_free(body->code);
+	if (body->list)
+		skO_free(body->list);
+}
+
+void loop_open (skE *env, loop *l, skO *op)
+{
+	body_open(env, &l->op, op);
+	l->cond.list = NULL;
+	l->cond.code = NULL;
+	l->list      = NULL;
+	l->held      = NULL;
+	l->runs      = 0;
+}
+
+void loop_close (loop *l)
+{
+	body_close(&l->op);
+	body_close(&l->cond);
+	if (l->list)
+		skO_free(l->list);
+	if (l->held)
+		skO_free(l->held);
+}
+
+/*
+Run `fn' on an open loop, then close it. If the loop fails, it is closed
+before the error is passed on.
+*/
+void loop_run (skE *env, loop *l, loop_fn *fn)
+{
+	jmp_buf jmp;
+
+	memcpy(jmp, env->jmp, sizeof(jmp_buf));
+
+	if (setjmp(env->jmp)) {
+		memcpy(env->jmp, jmp, sizeof(jmp_buf));
+		loop_close(l);
+		longjmp(env->jmp, 1);
+	}
+
+	fn(env, l);
+
+	memcpy(env->jmp, jmp, sizeof(jmp_buf));
+	loop_close(l);
+}
+
+/*
+Call the operation `name' of the current scope, which is the intrinsic
+`native' unless it has been redefined.
+*/
+void call_scoped (skE *env, symbol *name, skE_natOp *native)
+{
+	skO *list;
+
+	if (!name->defs) {
+		native(env);
+		return;
+	}
+
+	list = skO_list_new();
+	sk_list_append(list, skO_symbol_new_n(name->name, name->length));
+	skE_execList(env, list, 0);
+}
+
+int pop_boolean (skE *env)
+{
+	skV b = skE_stackPopValue(env);
+
+	skV_checkType(&b, SKO_BOOLEAN);
+
+	return b.data.boolean;
+}
+
+SK_INTRINSIC skI_if (skE *env)
+{
+	skO *branches = skE_stackPop(env);
+	skV cond      = skE_stackPopValue(env);
+	skO *iftrue;
+	skO *iffalse;
+
+	iftrue  = sk_list_uncons(branches);
+	iffalse = iftrue ? sk_list_uncons(branches) : NULL;
+
+	if (!iffalse) {
+		fprintf(stderr, "PANIC! Tried to uncons an empty list.\n");
+		longjmp(env->jmp, 1);
+	}
+
+	skO_checkList(iftrue);
+	skV_checkType(&cond, SKO_BOOLEAN);
+	skO_checkList(iffalse);
+
+	skO_free(branches);
+
+	if (cond.data.boolean) {
+		skO_free(iffalse);
+		iffalse = iftrue;
+	} else {
+		skO_free(iftrue);
+	}
+
+	return iffalse;
+}
+
+void while_loop (skE *env, loop *l)
+{
+	while (1) {
+		body_run(env, &l->cond);
+		if (!pop_boolean(env))
+			break;
+		body_run(env, &l->op);
+	}
+}
+
+SK_INTRINSIC skI_while (skE *env)
+{
+	skO  *cond = skE_stackPop(env);
+	loop l;
+
+	loop_open(env, &l, skE_stackPop(env));
+	body_open(env, &l.cond, cond);
+	loop_run(env, &l, while_loop);
+
+	return NULL;
+}
+
+void times_loop (skE *env, loop *l)
+{
+	while (l->runs > 0) {
+		l->runs -= 1;
+		body_run(env, &l->op);
+	}
+}
+
+SK_INTRINSIC skI_times (skE *env)
+{
+	skV  n = skE_stackPopValue(env);
+	loop l;
+
+	loop_open(env, &l, skE_stackPop(env));
+	skV_checkType(&n, SKO_NUMBER);
+	l.runs = skV_double(n);
+	loop_run(env, &l, times_loop);
+
+	return NULL;
+}
+
+void each_loop (skE *env, loop *l)
+{
+	skO *el;
+
+	while ((el = sk_list_uncons(l->list))) {
+		skE_stackPush(env, el);
+		body_run(env, &l->op);
+	}
+}
+
+SK_INTRINSIC skI_each (skE *env)
+{
+	loop l;
+
+	loop_open(env, &l, skE_stackPop(env));
+	l.list = skE_stackPop(env);
+	skO_checkList(l.list);
+	loop_run(env, &l, each_loop);
+
+	return NULL;
+}
+
+SK_INTRINSIC skI_fold (skE *env)
+{
+	skO  *seed = skE_stackPop(env);
+	skO  *cont;
+	loop l;
+
+	loop_open(env, &l, skE_stackPop(env));
+	l.list = skE_stackPop(env);
+	skO_checkList(l.list);
+
+	/* Folding an empty list calls `abort', then yields the seed. */
+	if (!l.list->length) {
+		skE_stackPush(env, l.list);
+		l.list = NULL;
+		loop_close(&l);
+
+		cont = skO_list_new();
+		sk_list_append(cont, skO_symbol_new("abort"));
+		sk_list_append(cont, skO_symbol_new("<<"));
+		sk_list_append(cont, seed);
+
+		return cont;
+	}
+
+	skE_stackPush(env, seed);
+	loop_run(env, &l, each_loop);
+
+	return NULL;
+}
+
+void map_loop (skE *env, loop *l)
+{
+	symbol *cons = sk_symbol_intern("cons", 4);
+	skO    *el;
+
+	while ((el = sk_list_uncons(l->list))) {
+		skE_stackPush(env, el);
+		body_run(env, &l->op);
+		call_scoped(env, cons, skI_cons);
+	}
+}
+
+SK_INTRINSIC skI_map (skE *env)
+{
+	loop l;
+
+	loop_open(env, &l, skE_stackPop(env));
+	l.list = skE_stackPop(env);
+	skO_checkList(l.list);
+
+	skE_stackPush(env, skO_list_new());
+	loop_run(env, &l, map_loop);
+	call_scoped(env, sk_symbol_intern("reverse", 7), skI_reverse);
+
+	return NULL;
+}
+
+void filter_loop (skE *env, loop *l)
+{
+	symbol *cons = sk_symbol_intern("cons", 4);
+
+	while ((l->held = sk_list_uncons(l->list))) {
+		skE_stackPush(env, skO_clone(l->held));
+		body_run(env, &l->op);
+
+		if (pop_boolean(env)) {
+			skE_stackPush(env, l->held);
+			l->held = NULL;
+			call_scoped(env, cons, skI_cons);
+		} else {
+			skO_free(l->held);
+		}
+	}
+}
+
+SK_INTRINSIC skI_filter (skE *env)
+{
+	loop l;
+
+	loop_open(env, &l, skE_stackPop(env));
+	l.list = skE_stackPop(env);
+	skO_checkList(l.list);
+
+	skE_stackPush(env, skO_list_new());
+	loop_run(env, &l, filter_loop);
+	call_scoped(env, sk_symbol_intern("reverse", 7), skI_reverse);
+
+	return NULL;
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                             LIST OPERATIONS                              //
+////////////////////////////////////////////////////////////////////////////*/
+
+/*
+These intrinsics replace the definitions of `lib/lists.shk'. They work by
+relinking the members of their arguments rather than by copying them, and
+allocate no object except for the groups built by `split'.
+*/
+
+SK_INTRINSIC skI_reverse (skE *env)
+{
+	skO *list = skE_stackPop(env);
+
+	sk_list_reverse(list);
+	skE_stackPush(env, list);
+
+	return NULL;
+}
+
+SK_INTRINSIC skI_concat (skE *env)
+{
+	skO *r = skE_stackPop(env);
+	skO *l = skE_stackPop(env);
+
+	skO_checkList(l);
+
+	/* Like the Shirka version, `r' is returned as is if `l' is empty. */
+	if (!l->length) {
+		skO_free(l);
+		skE_stackPush(env, r);
+		return NULL;
+	}
+
+	skO_checkList(r);
+
+	sk_list_append(l, r->data.list);
+	r->data.list = NULL;
+	skO_free(r);
+
+	skE_stackPush(env, l);
+
+	return NULL;
+}
+
+SK_INTRINSIC skI_append (skE *env)
+{
+	skO *obj  = skE_stackPop(env);
+	skO *list = skE_stackPop(env);
+
+	sk_list_append(list, obj);
+	skE_stackPush(env, list);
+
+	return NULL;
+}
+
+/*
+Move `nb' members from the front of a list to a new one. As in the Shirka
+version, they end up in reverse order, on top of the rest of the list.
+*/
+SK_INTRINSIC skI_take (skE *env)
+{
+	skV nb    = skE_stackPopValue(env);
+	skO *list = skE_stackPop(env);
+	skO *taken;
+	skO *el;
+
+	skV_checkType(&nb, SKO_NUMBER);
+	set_number(&nb, skV_double(nb));
+	taken = skO_list_new();
+
+	while (nb.data.number > 0) {
+		nb.data.number -= 1;
+
+		el = sk_list_uncons(list);
+		if (!el) {
+			fprintf(stderr, "PANIC! Tried to uncons an empty list.\n");
+			longjmp(env->jmp, 1);
+		}
+
+		sk_list_cons(taken, el);
+	}
+
+	skE_stackPush(env, list);
+	skE_stackPush(env, taken);
+
+	return NULL;
+}
+
+SK_INTRINSIC skI_split (skE *env)
+{
+	skO *val    = skE_stackPop(env);
+	skO *list   = skE_stackPop(env);
+	skO *groups = skO_list_new();
+	skO *group  = skO_list_new();
+	skO *el;
+
+	skO_checkList(list);
+
+	while ((el = sk_list_uncons(list))) {
+		if (skO_eql(el, val)) {
+			skO_free(el);
+			sk_list_append(groups, group);
+			group = skO_list_new();
+		} else {
+			sk_list_append(group, el);
+		}
+	}
+
+	sk_list_append(groups, group);
+
+	skO_free(val);
+	skO_free(list);
+	skE_stackPush(env, groups);
+
+	return NULL;
+}
+
+SK_INTRINSIC skI_included (skE *env)
+{
+	skO *element = skE_stackPop(env);
+	skO *list    = skE_stackPop(env);
+	skO *node;
+	int found = 0;
+
+	skO_checkList(list);
+
+	for (node = list->data.list; node && !found; node = node->next)
+		found = skO_eql(node, element);
+
+	skO_free(element);
+	skE_stackPush(env, list);
+	skE_stackPush(env, skO_boolean_new(found));
+
+	return NULL;
+}
@@ -0,0 +1,299 @@
+/* Copyright (c) 2013, Jeremy Pinat. */
+
+/*
+Memoization
+===========
+
+`memoize' turns an operation into a memoized one: each call looks the
+objects the operation takes from the stack up in a cache, and if they were
+seen before, replaces them with the objects the operation left then instead
+of running it. The number of objects taken (the arity) is declared by the
+user, and so is the purity of the operation: it must have no other effect
+than replacing its arguments with its results.
+
+Arguments are compared by structure and type: `1' and `1.0', or a string
+and the list of its characters, are different arguments. They are found
+through a hash table; the cache keeps the `SK_MEMO_SIZE' most recently used
+entries and evicts the least recently used one when full.
+
+Hits, misses and evictions are counted in `sk_counters'.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "shirka.h"
+
+#define SK_MEMO_SIZE    4096
+#define SK_MEMO_BUCKETS 1024 /* power of two */
+
+struct sk_memo_entry {
+	sk_memo_entry *chain;    /* next entry of the same bucket          */
+	sk_memo_entry *newer;    /* neighbours in order of use              */
+	sk_memo_entry *older;
+	unsigned long hash;
+	size_t        base;      /* depth of the stack below the arguments */
+	size_t        nresults;
+	skV           *values;   /* arguments, then results                */
+};
+
+struct sk_memo {
+	skO           *body;
+	skC_code      *code;
+	size_t        arity;
+	size_t        count;
+	sk_memo_entry *newest;
+	sk_memo_entry *oldest;
+	sk_memo_entry *buckets[SK_MEMO_BUCKETS];
+};
+
+sk_memo *sk_memo_new (skO *body, skC_code *code, size_t arity)
+{
+	sk_memo *memo = calloc(1, sizeof(sk_memo));
+
+	if (!memo)
+		FATAL("INTERPRETER ERROR! Out of memory.\n");
+
+	memo->body  = body;
+	memo->code  = code;
+	memo->arity = arity;
+
+	return memo;
+}
+
+void values_free (skV *values, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		if (SKV_BOXED(values[i].tag))
+			skO_free(values[i].data.obj);
+	}
+
+	free(values);
+}
+
+void sk_memo_discard (sk_memo *memo, sk_memo_entry *entry)
+{
+	if (!entry)
+		return;
+
+	values_free(entry->values, memo->arity + entry->nresults);
+	free(entry);
+}
+
+void sk_memo_free (sk_memo *memo)
+{
+	sk_memo_entry *entry = memo->newest;
+	sk_memo_entry *older;
+
+	while (entry) {
+		older = entry->older;
+		sk_memo_discard(memo, entry);
+		entry = older;
+	}
+
+	skO_free(memo->body);
+	if (memo->code)
+		skC_free(memo->code);
+	free(memo);
+}
+
+skO *sk_memo_body (sk_memo *memo)
+{
+	return memo->body;
+}
+
+skC_code *sk_memo_code (sk_memo *memo)
+{
+	return memo->code;
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                   KEYS                                   //
+////////////////////////////////////////////////////////////////////////////*/
+
+skV value_copy (skV v)
+{
+	if (SKV_BOXED(v.tag))
+		v.data.obj = skO_clone(v.data.obj);
+
+	return v;
+}
+
+skV *values_copy (skV *values, size_t count)
+{
+	skV    *copy = malloc((count ? count : 1) * sizeof(skV));
+	size_t i;
+
+	if (!copy)
+		FATAL("INTERPRETER ERROR! Out of memory.\n");
+
+	for (i = 0; i < count; i++)
+		copy[i] = value_copy(values[i]);
+
+	return copy;
+}
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                  CACHE                                   //
+////////////////////////////////////////////////////////////////////////////*/
+
+void lru_unlink (sk_memo *memo, sk_memo_entry *entry)
+{
+	if (entry->newer)
+		entry->newer->older = entry->older;
+	else
+		memo->newest = entry->older;
+
+	if (entry->older)
+		entry->older->newer = entry->newer;
+	else
+		memo->oldest = entry->newer;
+}
+
+void lru_push (sk_memo *memo, sk_memo_entry *entry)
+{
+	entry->newer = NULL;
+	entry->older = memo->newest;
+
+	if (memo->newest)
+		memo->newest->newer = entry;
+	else
+		memo->oldest = entry;
+
+	memo->newest = entry;
+}
+
+void memo_evict (sk_memo *memo)
+{
+	sk_memo_entry *entry = memo->oldest;
+	sk_memo_entry **link;
+
+	link = &memo->buckets[entry->hash & (SK_MEMO_BUCKETS - 1)];
+
+	while (*link != entry)
+		link = &(*link)->chain;
+	*link = entry->chain;
+
+	lru_unlink(memo, entry);
+	sk_memo_discard(memo, entry);
+	memo->count--;
+	sk_counters.memo_evictions++;
+}
+
+/*
+Arguments equal by type and structure are also equal for `skO_eql', and
+thus have the same hash.
+*/
+unsigned long arguments_hash (sk_memo *memo, skV *args)
+{
+	unsigned long h = 0;
+	size_t        i;
+
+	for (i = 0; i < memo->arity; i++)
+		h = h * 31 + skV_hash(args[i]);
+
+	return h;
+}
+
+int sk_memo_lookup (sk_memo *memo, skE *env)
+{
+	skV           *args;
+	unsigned long h;
+	sk_memo_entry *entry;
+	size_t        i;
+
+	if (env->depth < memo->arity)
+		return 0;
+
+	args = &env->stack[env->depth - memo->arity];
+	h    = arguments_hash(memo, args);
+
+	for (entry = memo->buckets[h & (SK_MEMO_BUCKETS - 1)]; entry;
+		entry = entry->chain) {
+		if (entry->hash != h)
+			continue;
+		for (i = 0; i < memo->arity; i++) {
+			if (!skV_eql(entry->values[i], args[i], 1))
+				break;
+		}
+		if (i == memo->arity)
+			break;
+	}
+
+	if (!entry) {
+		sk_counters.memo_misses++;
+		return 0;
+	}
+
+	sk_counters.memo_hits++;
+
+	lru_unlink(memo, entry);
+	lru_push(memo, entry);
+
+	for (i = 0; i < memo->arity; i++) {
+		if (SKV_BOXED(args[i].tag))
+			skO_free(args[i].data.obj);
+	}
+	env->depth -= memo->arity;
+	SKE_TOUCH(env, env->depth);
+
+	for (i = 0; i < entry->nresults; i++)
+		skE_stackPushValue(env, value_copy(entry->values[memo->arity + i]));
+
+	return 1;
+}
+
+sk_memo_entry *sk_memo_begin (sk_memo *memo, skE *env)
+{
+	sk_memo_entry *entry;
+
+	if (env->depth < memo->arity)
+		return NULL;
+
+	entry = malloc(sizeof(sk_memo_entry));
+	if (!entry)
+		FATAL("INTERPRETER ERROR! Out of memory.\n");
+
+	entry->base     = env->depth - memo->arity;
+	entry->nresults = 0;
+	entry->values   = values_copy(&env->stack[entry->base], memo->arity);
+	entry->hash     = arguments_hash(memo, entry->values);
+
+	return entry;
+}
+
+void sk_memo_end (sk_memo *memo, sk_memo_entry *entry, skE *env)
+{
+	sk_memo_entry **bucket;
+	size_t        i;
+
+	if (!entry)
+		return;
+
+	/* The operation took more objects than its declared arity. */
+	if (env->low < entry->base) {
+		sk_memo_discard(memo, entry);
+		return;
+	}
+
+	entry->nresults = env->depth - entry->base;
+	entry->values   = realloc(entry->values,
+		(memo->arity + entry->nresults + 1) * sizeof(skV));
+	if (!entry->values)
+		FATAL("INTERPRETER ERROR! Out of memory.\n");
+
+	for (i = 0; i < entry->nresults; i++) {
+		entry->values[memo->arity + i] =
+			value_copy(env->stack[entry->base + i]);
+	}
+
+	if (memo->count == SK_MEMO_SIZE)
+		memo_evict(memo);
+
+	bucket       = &memo->buckets[entry->hash & (SK_MEMO_BUCKETS - 1)];
+	entry->chain = *bucket;
+	*bucket      = entry;
+	lru_push(memo, entry);
+	memo->count++;
+}
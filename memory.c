@@ -0,0 +1,146 @@
+/* Copyright (c) 2013, Jeremy Pinat. */
+
+/*
+Memory pools
+============
+
+Objects, contexts and reserved nodes are small, fixed-size structures that
+are created and released at a very high rate while a program runs (every
+arithmetic result, every character of a string, every scope...). Instead of
+going through `malloc' and `free' for each of them, they are carved out of
+large slabs and recycled through free lists.
+
+Blocks are grouped in *size classes* (multiples of `SK_M_ALIGN' bytes up to
+`SK_M_MAX_SIZE'). Each class owns a free list; when it is empty, a new slab
+is requested from the system and split into blocks of that class. Slabs are
+never returned to the system: memory released by the program is kept for
+later allocations of the same class.
+
+Requests larger than `SK_M_MAX_SIZE' are forwarded to `malloc'.
+
+Since the size of a block is always known by its owner, it is not stored in
+the block itself and must be given back to `skM_free'.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "shirka.h"
+
+#define SK_M_ALIGN      8
+#define SK_M_MAX_SIZE   256
+#define SK_M_CLASSES    (SK_M_MAX_SIZE / SK_M_ALIGN)
+#define SK_M_SLAB_SIZE  (64 * 1024)
+
+#define SIZE_CLASS(size) (((size) + SK_M_ALIGN - 1) / SK_M_ALIGN - 1)
+
+typedef struct block block;
+typedef struct slab  slab;
+
+struct block {
+	block *next;
+};
+
+struct slab {
+	slab *next;
+};
+
+block *free_lists[SK_M_CLASSES];
+slab  *slabs = NULL;
+
+skM_stats skM_counters;
+
+/*
+Split a new slab into blocks of the given class and put them in the
+corresponding free list.
+*/
+void slab_refill (size_t class)
+{
+	size_t block_size = (class + 1) * SK_M_ALIGN;
+	size_t header     = (sizeof(slab) + SK_M_ALIGN - 1) & ~(SK_M_ALIGN - 1);
+	char   *mem       = malloc(SK_M_SLAB_SIZE);
+	char   *cursor;
+	char   *end;
+	block  *b;
+
+	if (!mem)
+		FATAL("INTERPRETER ERROR! Out of memory.\n");
+
+	((slab *)mem)->next = slabs;
+	slabs = (slab *)mem;
+
+	skM_counters.slabs++;
+
+	cursor = mem + header;
+	end    = mem + SK_M_SLAB_SIZE - block_size;
+
+	while (cursor <= end) {
+		b = (block *)cursor;
+		b->next = free_lists[class];
+		free_lists[class] = b;
+		cursor += block_size;
+	}
+}
+
+void *skM_alloc (size_t size)
+{
+	size_t class;
+	block  *b;
+
+	skM_counters.allocs++;
+	skM_counters.live++;
+	if (skM_counters.live > skM_counters.peak)
+		skM_counters.peak = skM_counters.live;
+
+	if (size > SK_M_MAX_SIZE) {
+		b = malloc(size);
+		if (!b)
+			FATAL("INTERPRETER ERROR! Out of memory.\n");
+		return b;
+	}
+
+	class = SIZE_CLASS(size);
+
+	if (!free_lists[class])
+		slab_refill(class);
+
+	b = free_lists[class];
+	free_lists[class] = b->next;
+
+	return b;
+}
+
+void skM_free (void *ptr, size_t size)
+{
+	size_t class;
+	block  *b = ptr;
+
+	skM_counters.frees++;
+	skM_counters.live--;
+
+	if (size > SK_M_MAX_SIZE) {
+		free(ptr);
+		return;
+	}
+
+	class = SIZE_CLASS(size);
+
+	b->next = free_lists[class];
+	free_lists[class] = b;
+}
+
+void skM_release (void)
+{
+	slab *s = slabs;
+	slab *next;
+	size_t i;
+
+	while (s) {
+		next = s->next;
+		free(s);
+		s = next;
+	}
+
+	slabs = NULL;
+	for (i = 0; i < SK_M_CLASSES; i++)
+		free_lists[i] = NULL;
+}
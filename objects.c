@@ -1,41 +1,233 @@
 /* Copyright (c) 2013, Jeremy Pinat. */
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include "shirka.h"
 
-symbol *symbol_list = NULL;
+/*
+Symbols are interned: there is exactly one `symbol' per distinct name, so
+that comparing two symbols is a pointer comparison. They are looked up
+through an open-addressing hash table (linear probing, power-of-two size,
+kept at most half full) and never released. Their names are packed one
+after the other in a string arena instead of living in fixed-size buffers.
+*/
 
-symbol *symbol_id_from_string (char *str)
+#define SYMBOL_TABLE_MIN   256
+#define NAME_ARENA_SIZE    (16 * 1024)
+
+symbol **symbol_table    = NULL;
+size_t symbol_table_size = 0;
+size_t symbol_count      = 0;
+
+char   *name_arena       = NULL;
+size_t name_arena_left   = 0;
+
+unsigned symbol_hash (const char *str, size_t length)
 {
-	symbol *sym = symbol_list;
+	unsigned h = 2166136261u;
+	size_t   i;
 
-	while (sym) {
-		if (strcmp(str, sym->name) == 0) {
-			goto symbol_found;
+	for (i = 0; i < length; i++) {
+		h ^= (unsigned char)str[i];
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+/*
+Copy a name (and its terminating 0) into the string arena.
+*/
+char *name_store (const char *str, size_t length)
+{
+	char *name;
+
+	if (length + 1 > name_arena_left) {
+		if (length + 1 > NAME_ARENA_SIZE / 4) {
+			name = malloc(length + 1);
+			goto copy;
 		}
+		name_arena      = malloc(NAME_ARENA_SIZE);
+		name_arena_left = NAME_ARENA_SIZE;
+	}
+
+	name             = name_arena;
+	name_arena      += length + 1;
+	name_arena_left -= length + 1;
+
+copy:
+	memcpy(name, str, length);
+	name[length] = 0;
+	return name;
+}
+
+void symbol_table_grow (void)
+{
+	symbol **old      = symbol_table;
+	size_t   old_size = symbol_table_size;
+	size_t   mask;
+	size_t   i;
+	size_t   j;
+
+	symbol_table_size = old_size ? old_size * 2 : SYMBOL_TABLE_MIN;
+	symbol_table      = calloc(symbol_table_size, sizeof(symbol *));
+	mask              = symbol_table_size - 1;
+
+	for (i = 0; i < old_size; i++) {
+		if (!old[i])
+			continue;
+		j = old[i]->hash & mask;
+		while (symbol_table[j])
+			j = (j + 1) & mask;
+		symbol_table[j] = old[i];
+	}
 
-		sym = sym->next;
+	free(old);
+}
+
+symbol *sk_symbol_intern (const char *str, size_t length)
+{
+	unsigned hash = symbol_hash(str, length);
+	size_t   mask;
+	size_t   i;
+	symbol   *sym;
+
+	if (2 * (symbol_count + 1) > symbol_table_size)
+		symbol_table_grow();
+
+	mask = symbol_table_size - 1;
+	i    = hash & mask;
+
+	while ((sym = symbol_table[i])) {
+		if (sym->hash == hash && sym->length == length
+			&& memcmp(sym->name, str, length) == 0)
+			return sym;
+		i = (i + 1) & mask;
 	}
 
-	sym = malloc(sizeof(symbol));
-	strcpy(sym->name, str);
-	sym->next = symbol_list;
+	sym         = skM_alloc(sizeof(symbol));
+	sym->name   = name_store(str, length);
+	sym->length  = length;
+	sym->hash    = hash;
+	sym->defs    = 0;
+	sym->version = 1;
+	#ifdef SK_PROFILE
+	sym->profile = NULL;
+	#endif
 
-	symbol_list = sym;
+	symbol_table[i] = sym;
+	symbol_count++;
 
-symbol_found:
 	return sym;
 }
 
-skO *skO_clone (skO *obj)
+void sk_symbol_invalidate (void)
+{
+	size_t i;
+
+	for (i = 0; i < symbol_table_size; i++) {
+		if (symbol_table[i])
+			symbol_table[i]->version++;
+	}
+}
+
+symbol *symbol_id_from_string (char *str)
+{
+	return sk_symbol_intern(str, strlen(str));
+}
+
+sk_stats sk_counters;
+
+/*
+Allocate or release the memory of an object, keeping count of objects by
+tag. Since a few operations change the tag of objects in place, only the
+totals of both counts match.
+
+Scalars are allocated without the `length' and `last' fields of lists and
+strings. Tags are only changed in place from a scalar tag to another, or
+from `SKO_STRING' to `SKO_LIST', so the size of an object always follows
+from its current tag.
+*/
+size_t object_size (skO_t tag)
+{
+	return SKV_BOXED(tag) ? sizeof(skO) : offsetof(skO, length);
+}
+
+skO *object_alloc (skO_t tag)
+{
+	sk_counters.allocs[tag]++;
+	if (++sk_counters.live > sk_counters.peak_live)
+		sk_counters.peak_live = sk_counters.live;
+
+	return skM_alloc(object_size(tag));
+}
+
+void object_release (skO *obj)
+{
+	sk_counters.frees[obj->tag]++;
+	sk_counters.live--;
+
+	skM_free(obj, object_size(obj->tag));
+}
+
+const char *STAT_TAGS[SKO_TAGS] = {
+	"Number", "Boolean", "Character", "QuotedSymbol", "Symbol", "List",
+	"String", "Integer"
+};
+
+size_t stat_add (sk_stat *stats, size_t n, const char *name,
+                 const char *suffix, unsigned long value)
+{
+	sprintf(stats[n].name, "%s%s", name, suffix);
+	stats[n].value = value;
+
+	return n + 1;
+}
+
+size_t sk_stats_collect (sk_stat *stats)
+{
+	size_t n = 0;
+	size_t i;
+
+	for (i = 0; i < SKO_TAGS; i++)
+		n = stat_add(stats, n, "allocs/", STAT_TAGS[i], sk_counters.allocs[i]);
+	for (i = 0; i < SKO_TAGS; i++)
+		n = stat_add(stats, n, "frees/", STAT_TAGS[i], sk_counters.frees[i]);
+
+	n = stat_add(stats, n, "exec/instructions", "",
+		sk_counters.instructions);
+	n = stat_add(stats, n, "objects/live", "", sk_counters.live);
+	n = stat_add(stats, n, "objects/peak", "", sk_counters.peak_live);
+	n = stat_add(stats, n, "clone/calls", "", sk_counters.clones);
+	n = stat_add(stats, n, "clone/objects", "", sk_counters.cloned);
+	n = stat_add(stats, n, "lookup/calls", "", sk_counters.lookups);
+	n = stat_add(stats, n, "lookup/nodes", "", sk_counters.lookup_nodes);
+	n = stat_add(stats, n, "scope/pushes", "", sk_counters.scope_pushes);
+	n = stat_add(stats, n, "scope/pops", "", sk_counters.scope_pops);
+	n = stat_add(stats, n, "stack/peak", "", sk_counters.peak_depth);
+	n = stat_add(stats, n, "memo/hits", "", sk_counters.memo_hits);
+	n = stat_add(stats, n, "memo/misses", "", sk_counters.memo_misses);
+	n = stat_add(stats, n, "memo/evictions", "", sk_counters.memo_evictions);
+	n = stat_add(stats, n, "memory/allocs", "", skM_counters.allocs);
+	n = stat_add(stats, n, "memory/frees", "", skM_counters.frees);
+	n = stat_add(stats, n, "memory/live", "", skM_counters.live);
+	n = stat_add(stats, n, "memory/peak", "", skM_counters.peak);
+	n = stat_add(stats, n, "memory/slabs", "", skM_counters.slabs);
+
+	return n;
+}
+
+skO *object_clone (skO *obj)
 {
 	skO *copy;
 	skO *iter;
 	skO *child_copy;
 
-	copy       = malloc(sizeof(skO));
+	sk_counters.cloned++;
+
+	copy       = object_alloc(obj->tag);
 	copy->next = NULL;
 	copy->tag  = obj->tag;
 
@@ -43,20 +235,35 @@ skO *skO_clone (skO *obj)
 	case SKO_SYMBOL:
 	case SKO_QSYMBOL:
 	case SKO_NUMBER:
+	case SKO_INTEGER:
 	case SKO_BOOLEAN:
 	case SKO_CHARACTER:
 		copy->data = obj->data;
 		break;
 	case SKO_LIST:
 		copy->data.list = NULL;
+		copy->length    = 0;
+		copy->last      = NULL;
 
 		iter = obj->data.list;
 		while (iter) {
-			child_copy = skO_clone(iter);
+			child_copy = object_clone(iter);
 			sk_list_append(copy, child_copy);
 			iter = iter->next;
 		}
 
+		copy->hash = obj->hash;
+
+		break;
+	case SKO_STRING:
+		copy->length      = obj->length;
+		copy->data.string = NULL;
+
+		if (obj->length) {
+			copy->data.string = skM_alloc(obj->length);
+			memcpy(copy->data.string, obj->data.string, obj->length);
+		}
+
 		break;
 	default:
 		fprintf(stderr, "Internal type error.\n");
@@ -66,6 +273,13 @@ skO *skO_clone (skO *obj)
 	return copy;
 }
 
+skO *skO_clone (skO *obj)
+{
+	sk_counters.clones++;
+
+	return object_clone(obj);
+}
+
 void skO_free (skO *obj)
 {
 	skO *node;
@@ -80,12 +294,20 @@ void skO_free (skO *obj)
 			skO_free(node);
 			node = next;
 		}
+		object_release(obj);
+		break;
+	case SKO_STRING:
+		if (obj->length)
+			skM_free(obj->data.string, obj->length);
+		object_release(obj);
+		break;
 	case SKO_SYMBOL:
 	case SKO_QSYMBOL:
 	case SKO_NUMBER:
+	case SKO_INTEGER:
 	case SKO_BOOLEAN:
 	case SKO_CHARACTER:
-		free (obj);
+		object_release(obj);
 		break;
 	default:
 		fprintf(stderr, "Internal type error.\n");
@@ -96,7 +318,7 @@ void skO_free (skO *obj)
 
 skO *skO_number_new (double d)
 {
-	skO *obj = malloc(sizeof(skO));
+	skO *obj = object_alloc(SKO_NUMBER);
 
 	obj->next        = NULL;
 	obj->tag         = SKO_NUMBER;
@@ -105,9 +327,99 @@ skO *skO_number_new (double d)
 	return obj;
 }
 
+skO *skO_integer_new (long long i)
+{
+	skO *obj = object_alloc(SKO_INTEGER);
+
+	obj->next         = NULL;
+	obj->tag          = SKO_INTEGER;
+	obj->data.integer = i;
+
+	return obj;
+}
+
+double sk_number_double (skO *obj)
+{
+	if (obj->tag == SKO_INTEGER)
+		return (double)obj->data.integer;
+
+	return obj->data.number;
+}
+
+skV skV_of (skO *obj)
+{
+	skV v;
+
+	v.tag = obj->tag;
+
+	switch (obj->tag) {
+	case SKO_NUMBER:
+		v.data.number = obj->data.number;
+		break;
+	case SKO_INTEGER:
+		v.data.integer = obj->data.integer;
+		break;
+	case SKO_BOOLEAN:
+		v.data.boolean = obj->data.boolean;
+		break;
+	case SKO_CHARACTER:
+		v.data.character = obj->data.character;
+		break;
+	case SKO_SYMBOL:
+	case SKO_QSYMBOL:
+		v.data.sym = obj->data.sym;
+		break;
+	default:
+		v.data.obj = obj;
+		break;
+	}
+
+	return v;
+}
+
+skO *skV_box (skV v)
+{
+	skO *obj;
+
+	if (SKV_BOXED(v.tag))
+		return v.data.obj;
+
+	obj       = object_alloc(v.tag);
+	obj->next = NULL;
+	obj->tag  = v.tag;
+
+	switch (v.tag) {
+	case SKO_NUMBER:
+		obj->data.number = v.data.number;
+		break;
+	case SKO_INTEGER:
+		obj->data.integer = v.data.integer;
+		break;
+	case SKO_BOOLEAN:
+		obj->data.boolean = v.data.boolean;
+		break;
+	case SKO_CHARACTER:
+		obj->data.character = v.data.character;
+		break;
+	default:
+		obj->data.sym = v.data.sym;
+		break;
+	}
+
+	return obj;
+}
+
+double skV_double (skV v)
+{
+	if (v.tag == SKO_INTEGER)
+		return (double)v.data.integer;
+
+	return v.data.number;
+}
+
 skO *skO_boolean_new (int b)
 {
-	skO *obj = malloc(sizeof(skO));
+	skO *obj = object_alloc(SKO_BOOLEAN);
 
 	obj->next         = NULL;
 	obj->tag          = SKO_BOOLEAN;
@@ -118,7 +430,7 @@ skO *skO_boolean_new (int b)
 
 skO *skO_character_new (char c)
 {
-	skO *obj = malloc(sizeof(skO));
+	skO *obj = object_alloc(SKO_CHARACTER);
 
 	obj->next           = NULL;
 	obj->tag            = SKO_CHARACTER;
@@ -129,7 +441,7 @@ skO *skO_character_new (char c)
 
 skO *skO_quoted_symbol_new (char *a)
 {
-	skO *obj = malloc(sizeof(skO));
+	skO *obj = object_alloc(SKO_QSYMBOL);
 
 	obj->next     = NULL;
 	obj->tag      = SKO_QSYMBOL;
@@ -140,7 +452,7 @@ skO *skO_quoted_symbol_new (char *a)
 
 skO *skO_symbol_new (char *a)
 {
-	skO *obj = malloc(sizeof(skO));
+	skO *obj = object_alloc(SKO_SYMBOL);
 
 	obj->next     = NULL;
 	obj->tag      = SKO_SYMBOL;
@@ -149,33 +461,187 @@ skO *skO_symbol_new (char *a)
 	return obj;
 }
 
+skO *skO_symbol_new_n (char *a, size_t n)
+{
+	skO *obj = object_alloc(SKO_SYMBOL);
+
+	obj->next     = NULL;
+	obj->tag      = SKO_SYMBOL;
+	obj->data.sym = sk_symbol_intern(a, n);
+
+	return obj;
+}
+
 skO *skO_list_new (void)
 {
-	skO *obj = malloc(sizeof(skO));
+	skO *obj = object_alloc(SKO_LIST);
 
 	obj->next      = NULL;
 	obj->tag       = SKO_LIST;
+	obj->length    = 0;
 	obj->data.list = NULL;
+	obj->last      = NULL;
+	obj->hash      = 0;
 
 	return obj;
 }
 
+skO *skO_string_new (const char *bytes, size_t length)
+{
+	skO *obj = object_alloc(SKO_STRING);
+
+	obj->next        = NULL;
+	obj->tag         = SKO_STRING;
+	obj->length      = length;
+	obj->data.string = NULL;
+
+	if (length) {
+		obj->data.string = skM_alloc(length);
+		memcpy(obj->data.string, bytes, length);
+	}
+
+	return obj;
+}
+
+void sk_string_unpack (skO *obj)
+{
+	char   *bytes  = obj->data.string;
+	size_t length  = obj->length;
+	size_t i;
+
+	obj->tag       = SKO_LIST;
+	obj->length    = 0;
+	obj->data.list = NULL;
+	obj->last      = NULL;
+	obj->hash      = 0;
+
+	for (i = 0; i < length; i++)
+		sk_list_append(obj, skO_character_new(bytes[i]));
+
+	if (length)
+		skM_free(bytes, length);
+}
+
+char *sk_string_cstring (skO *obj)
+{
+	char   *str;
+	skO    *node;
+	size_t i = 0;
+
+	if (obj->tag == SKO_STRING) {
+		str = malloc(obj->length + 1);
+		if (obj->length)
+			memcpy(str, obj->data.string, obj->length);
+		str[obj->length] = 0;
+		return str;
+	}
+
+	skO_checkType(obj, SKO_LIST);
+	str = malloc(obj->length + 1);
+
+	node = obj->data.list;
+	while (node) {
+		str[i] = node->data.character;
+		i++;
+		node = node->next;
+	}
+	str[i] = 0;
+
+	return str;
+}
+
 void sk_list_append (skO *list, skO *obj)
 {
-	skO *node;
+	skO_checkList(list);
 
-	skO_checkType(list, SKO_LIST);
+	if (!obj)
+		return;
 
-	node = list->data.list;
+	list->hash = 0;
 
-	if (node) {
-		while (node->next) {
-			node = node->next;
-		}
-		node->next = obj;
-	} else {
+	if (list->last)
+		list->last->next = obj;
+	else
 		list->data.list = obj;
+
+	list->length++;
+	while (obj->next) {
+		obj = obj->next;
+		list->length++;
 	}
+
+	list->last = obj;
+}
+
+void sk_list_cons (skO *list, skO *obj)
+{
+	skO_checkList(list);
+
+	list->hash = 0;
+
+	obj->next = list->data.list;
+	list->data.list = obj;
+
+	if (!list->last)
+		list->last = obj;
+
+	list->length++;
+}
+
+skO *sk_list_uncons (skO *list)
+{
+	skO *obj;
+
+	skO_checkList(list);
+
+	obj = list->data.list;
+	if (!obj)
+		return NULL;
+
+	list->data.list = obj->next;
+	list->hash      = 0;
+	obj->next       = NULL;
+
+	if (!list->data.list)
+		list->last = NULL;
+
+	list->length--;
+
+	return obj;
+}
+
+void sk_list_set (skO *list, skO *head)
+{
+	skO_checkList(list);
+
+	list->data.list = NULL;
+	list->last      = NULL;
+	list->length    = 0;
+	list->hash      = 0;
+
+	sk_list_append(list, head);
+}
+
+void sk_list_reverse (skO *list)
+{
+	skO *node;
+	skO *next;
+	skO *reversed = NULL;
+
+	skO_checkList(list);
+
+	list->last = list->data.list;
+	list->hash = 0;
+
+	node = list->data.list;
+	while (node) {
+		next       = node->next;
+		node->next = reversed;
+		reversed   = node;
+		node       = next;
+	}
+
+	list->data.list = reversed;
 }
 
 const char *NUMBER_AS_STRING    = "Number";
@@ -184,16 +650,19 @@ const char *CHARACTER_AS_STRING = "Character";
 const char *QSYMBOL_AS_STRING   = "QuotedSymbol";
 const char *SYMBOL_AS_STRING    = "Symbol";
 const char *LIST_AS_STRING      = "List";
+const char *STRING_AS_STRING    = "String";
 
 const char *tystr (size_t i)
 {
 	switch (i) {
 	case SKO_NUMBER:    return NUMBER_AS_STRING;
+	case SKO_INTEGER:   return NUMBER_AS_STRING;
 	case SKO_BOOLEAN:   return BOOLEAN_AS_STRING;
 	case SKO_CHARACTER: return CHARACTER_AS_STRING;
 	case SKO_QSYMBOL:   return QSYMBOL_AS_STRING;
 	case SKO_SYMBOL:    return SYMBOL_AS_STRING;
 	case SKO_LIST:      return LIST_AS_STRING;
+	case SKO_STRING:    return STRING_AS_STRING;
 	default:
 		fprintf(stderr, "Internal type error.\n");
 		exit(EXIT_FAILURE);
@@ -205,7 +674,31 @@ void skO_checkType(skO *obj, skO_t type)
 	if (obj->tag == type)
 		return;
 
+	if (obj->tag == SKO_INTEGER && type == SKO_NUMBER)
+		return;
+
 	fprintf(stderr, "INTERPRETER ERROR! Expected `%s' but got `%s'.\n",
 		tystr(type), tystr(obj->tag));
 	exit(EXIT_FAILURE);
 }
+
+void skO_checkList (skO *obj)
+{
+	if (obj->tag == SKO_STRING)
+		sk_string_unpack(obj);
+
+	skO_checkType(obj, SKO_LIST);
+}
+
+void skV_checkType (skV *v, skO_t type)
+{
+	if (v->tag == type)
+		return;
+
+	if (v->tag == SKO_INTEGER && type == SKO_NUMBER)
+		return;
+
+	fprintf(stderr, "INTERPRETER ERROR! Expected `%s' but got `%s'.\n",
+		tystr(type), tystr(v->tag));
+	exit(EXIT_FAILURE);
+}
@@ -0,0 +1,117 @@
+/* Copyright (c) 2013, Jeremy Pinat. */
+
+/*
+Output
+======
+
+Printing objects one by one through stdio, and flushing after each of them,
+makes programs that print a lot spend most of their time issuing tiny
+writes. Instead, environments collect their output in a buffer of
+`SK_OUTPUT_SIZE' bytes, which is written out:
+
+- when it is full;
+- when input is about to be read, so that prompts are visible;
+- when the program calls the `flush' intrinsic;
+- at each new line, in line-buffered mode (`--line-buffered');
+- when the buffer is released, or at exit for buffers still in use.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "shirka.h"
+
+#define SK_OUTPUT_SIZE (64 * 1024)
+
+struct sk_output {
+	sk_output *next;          /* buffers flushed at exit */
+	FILE      *file;
+	int       line_buffered;
+	size_t    length;
+	char      data[SK_OUTPUT_SIZE];
+};
+
+sk_output *open_outputs = NULL;
+
+void flush_open_outputs (void)
+{
+	sk_output *out;
+
+	for (out = open_outputs; out; out = out->next)
+		sk_output_flush(out);
+}
+
+sk_output *sk_output_new (FILE *file, int line_buffered)
+{
+	sk_output *out = malloc(sizeof(sk_output));
+
+	if (!out)
+		FATAL("INTERPRETER ERROR! Out of memory.\n");
+
+	if (!open_outputs)
+		atexit(flush_open_outputs);
+
+	out->next          = open_outputs;
+	out->file          = file;
+	out->line_buffered = line_buffered;
+	out->length        = 0;
+	open_outputs       = out;
+
+	return out;
+}
+
+void sk_output_free (sk_output *out)
+{
+	sk_output **link = &open_outputs;
+
+	sk_output_flush(out);
+
+	while (*link != out)
+		link = &(*link)->next;
+	*link = out->next;
+
+	free(out);
+}
+
+void sk_output_flush (sk_output *out)
+{
+	if (out->length)
+		fwrite(out->data, 1, out->length, out->file);
+
+	out->length = 0;
+	fflush(out->file);
+}
+
+void sk_output_write (sk_output *out, const char *bytes, size_t length)
+{
+	if (!length)
+		return;
+
+	if (out->length + length > SK_OUTPUT_SIZE) {
+		sk_output_flush(out);
+
+		/* Too large to be buffered anyway. */
+		if (length > SK_OUTPUT_SIZE) {
+			fwrite(bytes, 1, length, out->file);
+			fflush(out->file);
+			return;
+		}
+	}
+
+	memcpy(out->data + out->length, bytes, length);
+	out->length += length;
+
+	if (out->line_buffered && memchr(bytes, '\n', length))
+		sk_output_flush(out);
+}
+
+void sk_output_char (sk_output *out, char c)
+{
+	if (out->length == SK_OUTPUT_SIZE)
+		sk_output_flush(out);
+
+	out->data[out->length++] = c;
+
+	if (out->line_buffered && c == '\n')
+		sk_output_flush(out);
+}
@@ -30,6 +30,7 @@ To enable the printing of debug information, define the constant
 */
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <setjmp.h>
 #include "shirka.h"
@@ -68,6 +69,7 @@ Token extractors
 */
 skO *parse_number            (char **next);
 skO *parse_character         (char **next, jmp_buf jmp);
+char parse_escaped           (char **next, jmp_buf jmp);
 skO *parse_character_literal (char **next, jmp_buf jmp);
 skO *parse_qidentifier       (char **next);
 skO *parse_identifier        (char **next);
@@ -103,66 +105,86 @@ void consume_leading (char **next)
 
 skO *parse_number (char **next)
 {
-	char *c = *next;
-	char buffer[SYMBOL_MAX_LENGTH];
-	short i = 0;
+	char      *start = *next;
+	char      *c     = start;
+	int       point  = 0;
+	long long i;
 
-	if (*c == '-' && c[1] >= '0' && c[1] <= '9') {
-		buffer[i] = *c;
-		i++;
+	if (*c == '-' && c[1] >= '0' && c[1] <= '9')
 		c++;
-	}
 
 	if (*c == '.')
 		return NULL;
 
-	while (1) {
-		if (!isdigit(*c))
-			break;
-		buffer[i] = *c;
-		i++;
+	while (isdigit(*c))
 		c++;
-	}
 
 	if (*c == '.') {
-		buffer[i] = *c;
-		i++;
+		point = 1;
 		c++;
-
-		while (1) {
-			if (!isdigit(*c))
-				break;
-			buffer[i] = *c;
-			i++;
+		if (!isdigit(*c))
+			return NULL;
+		while (isdigit(*c))
 			c++;
-		}
 	}
 
-	buffer[i] = 0;
-
-	if (SEPARATOR(*c) && i) {
-		char **dummy = NULL;
-		*next = c;
-		#ifdef SK_PARSER_DEBUG
-		printf("Parsed NUMBER:      %s\n", buffer);
-		#endif
-		return skO_number_new(strtod(buffer, dummy));
-	} else {
+	if (!SEPARATOR(*c) || c == start)
 		return NULL;
+
+	*next = c;
+	#ifdef SK_PARSER_DEBUG
+	printf("Parsed NUMBER:      %.*s\n", (int)(c - start), start);
+	#endif
+
+	/*
+	The number is read in place: `strtoll' and `strtod' stop at the
+	separator. Integers too large for a `long long' are read as floating
+	point numbers.
+	*/
+	if (!point) {
+		errno = 0;
+		i = strtoll(start, NULL, 10);
+		if (errno != ERANGE)
+			return skO_integer_new(i);
 	}
+
+	return skO_number_new(strtod(start, NULL));
 }
 
 skO *parse_character_literal (char **next, jmp_buf jmp)
 {
+	char *start = *next;
+	char *c;
+	skO  *chr;
+
 	if (**next != '\'')
 		return NULL;
 
 	++*next;
-	return parse_character(next, jmp);
+	chr = parse_character(next, jmp);
 
+	/* A character literal holds a single character: `'ab' is an error. */
+	c = *next;
+	if (!SEPARATOR(*c) && !(c[0] == '-' && c[1] == '-')) {
+		skO_free(chr);
+		fprintf(stderr, "PANIC! Parsing error: %s\n", start);
+		longjmp(jmp, 1);
+	}
+
+	return chr;
 }
 
 skO *parse_character (char **next, jmp_buf jmp)
+{
+	char result = parse_escaped(next, jmp);
+
+	#ifdef SK_PARSER_DEBUG
+	printf("Parsed CHARACTER:   %c\n", result);
+	#endif
+	return skO_character_new(result);
+}
+
+char parse_escaped (char **next, jmp_buf jmp)
 {
 	char *c = *next;
 	char result = 0;
@@ -201,29 +223,22 @@ skO *parse_character (char **next, jmp_buf jmp)
 			result = '\v';
 			break;
 		default:
-			FATAL("PANIC! Unknown escape sequence \\%c.\n", *c);
+			fprintf(stderr, "PANIC! Unknown escape sequence \\%c.\n", *c);
 			longjmp(jmp, 1);
 		}
-		#ifdef SK_PARSER_DEBUG
-		printf("Parsed CHARACTER:   \\%c\n", *c);
-		#endif
 	} else {
 		result = *c;
-		#ifdef SK_PARSER_DEBUG
-		printf("Parsed CHARACTER:   %c\n", *c);
-		#endif
 	}
 
 	c++;
 	*next = c;
-	return skO_character_new(result);
+	return result;
 }
 
 skO *parse_qidentifier (char **next)
 {
 	char *c = *next;
-	char buffer[SYMBOL_MAX_LENGTH];
-	short i = 0;
+	skO  *sym;
 
 	if (*c != ':')
 		goto failure;
@@ -233,29 +248,16 @@ skO *parse_qidentifier (char **next)
 	if (!IDENTIFIER_START(*c))
 		goto failure;
 
-	buffer[i] = *c;
-	i++;
-	c++;
-
-	while (1) {
-		if (c[0] == '-' && c[1] == '-')
-			break;
-
-		if (IDENTIFIER_CONT(*c)) {
-			buffer[i] = *c;
-			i++;
-			c++;
-		} else {
-			buffer[i] = 0;
-			break;
-		}
-	}
+	sym = parse_identifier(&c);
+	if (!sym)
+		goto failure;
+	sym->tag = SKO_QSYMBOL;
 
 	*next = c;
 	#ifdef SK_PARSER_DEBUG
-	printf("Parsed QIDENTIFIER: %s\n", buffer);
+	printf("Parsed QIDENTIFIER: %s\n", sym->data.sym->name);
 	#endif
-	return skO_quoted_symbol_new(buffer);
+	return sym;
 
 failure:
 	return NULL;
@@ -263,36 +265,34 @@ failure:
 
 skO *parse_identifier (char **next)
 {
-	char *c = *next;
-	char buffer[SYMBOL_MAX_LENGTH];
-	short i = 0;
+	char *start = *next;
+	char *c     = start;
 
 	if (!IDENTIFIER_START(*c))
 		goto failure;
 
-	buffer[i] = *c;
-	i++;
+	/* `.1' and `-.1' are malformed numbers, not identifiers. */
+	if ((c[0] == '.' && isdigit(c[1]))
+		|| (c[0] == '-' && c[1] == '.' && isdigit(c[2])))
+		goto failure;
+
 	c++;
 
 	while (1) {
 		if (c[0] == '-' && c[1] == '-')
 			break;
 
-		if (IDENTIFIER_CONT(*c)) {
-			buffer[i] = *c;
-			i++;
+		if (IDENTIFIER_CONT(*c))
 			c++;
-		} else {
-			buffer[i] = 0;
+		else
 			break;
-		}
 	}
 
 	*next = c;
 	#ifdef SK_PARSER_DEBUG
-	printf("Parsed IDENTIFIER:  %s\n", buffer);
+	printf("Parsed IDENTIFIER:  %.*s\n", (int)(c - start), start);
 	#endif
-	return skO_symbol_new(buffer);
+	return skO_symbol_new_n(start, c - start);
 
 failure:
 	return NULL;
@@ -369,45 +369,80 @@ skO *parse_obj_restore (char **next)
 
 skO *parse_string_literal (char **next, jmp_buf jmp)
 {
-	skO *list;
+	char    *c = *next;
+	char    *end;
+	char    *buffer;
+	char    *b;
+	skO     *str;
+	jmp_buf pe;
 
-	if (**next != '"')
+	if (*c != '"')
 		return NULL;
 
-	++*next;
-	list = skO_list_new();
+	c++;
 
-	while (**next != '"')
-		sk_list_append(list, parse_character(next, jmp));
-	++*next;
+	/* Find the closing quote; escaped characters are never quotes. */
+	end = c;
+	while (*end != '"') {
+		if (*end == 0) {
+			fprintf(stderr, "PANIC! Unterminated string literal.\n");
+			longjmp(jmp, 1);
+		}
+		if (*end == '\\' && end[1] != 0)
+			end++;
+		end++;
+	}
+
+	/* The decoded string can only be shorter than its literal. */
+	buffer = malloc(end - c + 1);
+	b      = buffer;
+
+	if (setjmp(pe)) {
+		free(buffer);
+		longjmp(jmp, 1);
+	}
+
+	while (c < end) {
+		*b = parse_escaped(&c, pe);
+		b++;
+	}
 
+	str = skO_string_new(buffer, b - buffer);
+	free(buffer);
+
+	*next = end + 1;
 	#ifdef SK_PARSER_DEBUG
-	printf("Parsed STRING\n");
+	printf("Parsed STRING:      %.*s\n", (int)str->length, str->data.string);
 	#endif
-	return list;
+	return str;
 }
 
 skO *skO_parse (char **next, jmp_buf jmp, char *delim)
 {
 	skO     *obj;                       /* parsed token (or NULL)       */
-	skO     *list     = skO_list_new(); /* used to store parsed objects */
-	skO     *prefixed = NULL;           /* store "prefix sugar" tokens  */
+	skO     *list;                      /* used to store parsed objects */
+	skO * volatile prefixed = NULL;     /* store "prefix sugar" tokens  */
 	char    *src      = *next;
 	jmp_buf pe;
 	int     ended     = 0;
 
 	consume_leading(&src);
 
+	if (delim && *src != delim[0])
+		return NULL;
+
+	list = skO_list_new();
+
 	if (setjmp(pe)) {
-		if (prefixed)
-			free(prefixed);
+		if (prefixed) {
+			prefixed->data.list = NULL;
+			skO_free(prefixed);
+		}
 		skO_free(list);
-		printf("parse jmp\n");
+		longjmp(jmp, 1);
 	}
 
 	if (delim) {
-		if (*src != delim[0])
-			return NULL;
 		src++;
 		consume_leading(&src);
 		#ifdef SK_PARSER_DEBUG
@@ -442,9 +477,10 @@ skO *skO_parse (char **next, jmp_buf jmp, char *delim)
 
 		/* Handle "prefix style" syntactic sugar. */
 
-		prefixed = skO_parse(&src, pe, "()");
-		if (prefixed)
+		if (*src == '(') {
+			prefixed = skO_parse(&src, pe, "()");
 			consume_leading(&src);
+		}
 
 		/* Handle "reserving operations" syntactic sugar. */
 
@@ -476,20 +512,21 @@ skO *skO_parse (char **next, jmp_buf jmp, char *delim)
 			|| (obj = parse_qidentifier(&src))
 			|| (obj = parse_identifier(&src))
 			|| (obj = parse_character_literal(&src, pe))
-			|| (obj = skO_parse(&src, pe, "[]")))
+			|| (*src == '[' && (obj = skO_parse(&src, pe, "[]"))))
 			goto matched;
 
 		/* If everything failed... */
 
 		fprintf(stderr, "PANIC! Parsing error: %s\n", src);
-		longjmp(jmp, 1);
+		longjmp(pe, 1);
 
 	matched:
 		sk_list_append(list, obj);
 		
 		if (prefixed) {
 			sk_list_append(list, prefixed->data.list);
-			free(prefixed);
+			prefixed->data.list = NULL;
+			skO_free(prefixed);
 			prefixed = NULL;
 		}
 	}
@@ -0,0 +1,242 @@
+/* Copyright (c) 2013, Jeremy Pinat. */
+
+/*
+Profiler
+========
+
+Interpreters built with `SK_PROFILE' record, for each operation and
+intrinsic, how many times it was called, the time spent in it and the
+number of blocks allocated from the memory pools while it ran. Without
+`SK_PROFILE', the hooks in the executor expand to nothing.
+
+Each call pushes an entry on a stack of active calls. When it returns, the
+time and allocations it took are added to the *total* (inclusive) figures
+of its symbol, and the same figures minus those of its callees to its
+*self* (exclusive) figures. Totals of recursive operations only count the
+outermost call, so that nested calls are not counted twice.
+
+Tail calls do not grow the stack: a tail call ends the entry of the
+previous tail call made by the same operation, if any, and starts its own.
+Calls reached through a chain of tail calls are thus accounted as callees of
+the operation that started the chain.
+
+A report sorted by self time is printed on the standard error stream at
+exit. If the `SHIRKA_PROFILE' environment variable is set, the figures are
+also written as JSON to the file it names.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "shirka.h"
+
+#ifdef SK_PROFILE
+
+struct sk_profile_record {
+	symbol        *sym;
+	unsigned long calls;
+	unsigned long active;       /* calls in progress                 */
+	double        total;        /* seconds                           */
+	double        self;
+	unsigned long total_allocs;
+	unsigned long self_allocs;
+};
+
+typedef struct {
+	sk_profile_record *record;
+	double            start;
+	double            children;        /* time spent in callees        */
+	unsigned long     start_allocs;
+	unsigned long     children_allocs;
+} profile_call;
+
+sk_profile_record **profile_records = NULL;
+size_t            profile_count     = 0;
+size_t            profile_size      = 0;
+
+profile_call      *profile_calls    = NULL;
+size_t            profile_depth     = 0;
+size_t            profile_capacity  = 0;
+
+double            profile_start;
+
+double profile_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+sk_profile_record *profile_record (symbol *sym)
+{
+	sk_profile_record *record;
+
+	if (sym->profile)
+		return sym->profile;
+
+	if (profile_count == profile_size) {
+		profile_size    = profile_size ? profile_size * 2 : 64;
+		profile_records = realloc(profile_records,
+			profile_size * sizeof(sk_profile_record *));
+	}
+
+	record = calloc(1, sizeof(sk_profile_record));
+	if (!record || !profile_records)
+		FATAL("INTERPRETER ERROR! Out of memory.\n");
+
+	record->sym    = sym;
+	sym->profile   = record;
+	profile_records[profile_count++] = record;
+
+	return record;
+}
+
+void sk_profile_enter (symbol *sym)
+{
+	profile_call *call;
+
+	if (profile_depth == profile_capacity) {
+		profile_capacity = profile_capacity ? profile_capacity * 2 : 256;
+		profile_calls    = realloc(profile_calls,
+			profile_capacity * sizeof(profile_call));
+		if (!profile_calls)
+			FATAL("INTERPRETER ERROR! Out of memory.\n");
+	}
+
+	call = &profile_calls[profile_depth++];
+
+	call->record          = profile_record(sym);
+	call->children        = 0;
+	call->children_allocs = 0;
+	call->start_allocs    = skM_counters.allocs;
+	call->start           = profile_now();
+
+	call->record->calls++;
+	call->record->active++;
+}
+
+void sk_profile_leave (void)
+{
+	profile_call      *call   = &profile_calls[--profile_depth];
+	sk_profile_record *record = call->record;
+	double            time    = profile_now() - call->start;
+	unsigned long     allocs  = skM_counters.allocs - call->start_allocs;
+
+	record->self        += time - call->children;
+	record->self_allocs += allocs - call->children_allocs;
+
+	if (!--record->active) {
+		record->total        += time;
+		record->total_allocs += allocs;
+	}
+
+	if (profile_depth) {
+		call[-1].children        += time;
+		call[-1].children_allocs += allocs;
+	}
+}
+
+size_t sk_profile_depth (void)
+{
+	return profile_depth;
+}
+
+void sk_profile_unwind (size_t depth)
+{
+	while (profile_depth > depth)
+		sk_profile_leave();
+}
+
+int profile_compare (const void *a, const void *b)
+{
+	const sk_profile_record *l = *(sk_profile_record * const *)a;
+	const sk_profile_record *r = *(sk_profile_record * const *)b;
+
+	if (l->self != r->self)
+		return l->self < r->self ? 1 : -1;
+
+	return strcmp(l->sym->name, r->sym->name);
+}
+
+void profile_json_string (FILE *f, const char *str)
+{
+	fputc('"', f);
+
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			fprintf(f, "\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			fprintf(f, "\\u%04x", (unsigned char)*str);
+		else
+			fputc(*str, f);
+	}
+
+	fputc('"', f);
+}
+
+void profile_json (char *path, double elapsed)
+{
+	FILE              *f = fopen(path, "w");
+	sk_profile_record *record;
+	size_t            i;
+
+	if (!f) {
+		fprintf(stderr, "WARNING! Could not write profile to %s.\n", path);
+		return;
+	}
+
+	fprintf(f, "{\"seconds\": %.6f, \"operations\": [", elapsed);
+
+	for (i = 0; i < profile_count; i++) {
+		record = profile_records[i];
+		fprintf(f, "%s\n  {\"name\": ", i ? "," : "");
+		profile_json_string(f, record->sym->name);
+		fprintf(f, ", \"calls\": %lu, \"total\": %.6f, \"self\": %.6f, "
+			"\"total_allocs\": %lu, \"self_allocs\": %lu}",
+			record->calls, record->total, record->self,
+			record->total_allocs, record->self_allocs);
+	}
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+}
+
+void profile_report (void)
+{
+	double            elapsed = profile_now() - profile_start;
+	sk_profile_record *record;
+	char              *json   = getenv("SHIRKA_PROFILE");
+	size_t            i;
+
+	sk_profile_unwind(0);
+	qsort(profile_records, profile_count, sizeof(sk_profile_record *),
+		&profile_compare);
+
+	fprintf(stderr, "\nProfile (%.3f s)\n\n", elapsed);
+	fprintf(stderr, "%-20s %10s %10s %10s %12s %12s\n", "operation", "calls",
+		"total ms", "self ms", "total allocs", "self allocs");
+
+	for (i = 0; i < profile_count; i++) {
+		record = profile_records[i];
+		fprintf(stderr, "%-20s %10lu %10.2f %10.2f %12lu %12lu\n",
+			record->sym->name, record->calls,
+			record->total * 1e3, record->self * 1e3,
+			record->total_allocs, record->self_allocs);
+	}
+
+	if (json)
+		profile_json(json, elapsed);
+}
+
+void sk_profile_init (void)
+{
+	profile_start = profile_now();
+	atexit(profile_report);
+}
+
+#endif
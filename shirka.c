@@ -1,34 +1,158 @@
 /* Copyright (c) 2013, Jeremy Pinat. */
 
+#define _POSIX_C_SOURCE 200112L
+
+#include <sys/resource.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "shirka.h"
 
+/*
+Directory of the prelude and its image. It can be changed at run time with
+the SHIRKA_LIB environment variable.
+*/
+#ifndef SK_LIB_PATH
+#define SK_LIB_PATH "lib"
+#endif
+
+/*
+Modules defining in Shirka the prelude operations provided as intrinsics,
+loaded instead of them with `--shirka-prelude'.
+*/
+const char *SHIRKA_PRELUDE[] = { "combinators.shk", "lists.shk", NULL };
+
+void usage (void)
+{
+	puts("Usage: shirka [--no-compile] [--shirka-prelude] [--line-buffered]\n"
+	     "              [--stats] FILE\n"
+	     "       shirka --build-image [FILE]\n"
+	     "Use - as FILE to read the program from the standard input.");
+	exit(EXIT_FAILURE);
+}
+
+/*
+Print the runtime counters on the standard error stream, for `--stats',
+followed by the peak resident set size of the process (in kilobytes on
+Linux, as reported by `getrusage').
+*/
+void print_stats (void)
+{
+	sk_stat       stats[SK_STATS_MAX];
+	size_t        count = sk_stats_collect(stats);
+	size_t        i;
+	struct rusage usage;
+
+	fprintf(stderr, "\nStatistics\n\n");
+	for (i = 0; i < count; i++)
+		fprintf(stderr, "%-24s %12lu\n", stats[i].name, stats[i].value);
+
+	if (!getrusage(RUSAGE_SELF, &usage))
+		fprintf(stderr, "%-24s %12ld\n", "process/peak-rss",
+			(long)usage.ru_maxrss);
+}
+
+/*
+Return the path of a file of the library directory, allocated with `malloc'.
+*/
+char *lib_file (const char *name)
+{
+	const char *dir = getenv("SHIRKA_LIB");
+	char       *path;
+
+	if (!dir)
+		dir = SK_LIB_PATH;
+
+	path = malloc(strlen(dir) + strlen(name) + 2);
+	sprintf(path, "%s/%s", dir, name);
+
+	return path;
+}
+
 int main (int argc, char const *argv[])
 {
 	skO *ast;
+	char * volatile path = NULL;
+	char *prelude;
+	char *image;
+	volatile int build = 0;
+	int i;
 	skE *env = skE_new();
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--no-compile") == 0)
+			env->flags |= SKE_NO_COMPILE;
+		else if (strcmp(argv[i], "--shirka-prelude") == 0)
+			env->flags |= SKE_SHIRKA_PRELUDE;
+		else if (strcmp(argv[i], "--stats") == 0)
+			atexit(print_stats);
+		else if (strcmp(argv[i], "--line-buffered") == 0)
+			env->flags |= SKE_LINE_BUFFERED;
+		else if (strcmp(argv[i], "--build-image") == 0)
+			build = 1;
+		else if ((argv[i][0] == '-' && argv[i][1]) || path)
+			usage();
+		else
+			path = (char *)argv[i];
+	}
+
+	if (!path && !build)
+		usage();
+
+	#ifdef SK_PROFILE
+	sk_profile_init();
+	#endif
+
 	skE_init(env);
 
 	if (setjmp(env->jmp)) {
+		sk_output_flush(env->out);
 		printf("Panic mode was set. Aborting.\n");
 		exit(EXIT_FAILURE);
 	}
 
-	if (argc != 2) {
-		puts("Wrong number of command line arguments.");
-		exit(EXIT_FAILURE);
+	prelude = lib_file("prelude.shk");
+	image   = lib_file("prelude.img");
+
+	/* Use the image of the prelude, unless it is missing or out of date. */
+	if (build || !skE_loadImage(env, image, prelude)) {
+		ast = skO_loadParse(prelude);
+		skE_execList(env, ast, 0);
 	}
 
-	ast = skO_loadParse("lib/prelude.shk");
-	skE_execList(env, ast, 0);
+	if (build && !skE_saveImage(env, image, prelude))
+		FATAL("INTERPRETER ERROR! Could not write image %s.\n", image);
+
+	free(prelude);
+	free(image);
+
+	/* Not part of the image, which is the same for all configurations. */
+	if (env->flags & SKE_SHIRKA_PRELUDE) {
+		for (i = 0; SHIRKA_PRELUDE[i]; i++) {
+			prelude = lib_file(SHIRKA_PRELUDE[i]);
+			ast = skO_loadParse(prelude);
+			skE_execList(env, ast, 0);
+			free(prelude);
+		}
+	}
 
-	ast = skO_loadParse((char *)argv[1]);
+	if (!path)
+		return 0;
+
+	ast = skO_loadParse(path);
 	skE_execList(env, ast, 1);
 
-	if (env->stack)
+	sk_output_flush(env->out);
+
+	if (env->depth)
 		printf("WARNING! Stack non empty upon exit.\n");
 
+	#ifdef SK_DEBUG_MEMORY
+	fprintf(stderr, "Memory: %lu allocs, %lu frees, %lu live, %lu peak, "
+		"%lu slabs\n", skM_counters.allocs, skM_counters.frees,
+		skM_counters.live, skM_counters.peak, skM_counters.slabs);
+	#endif
+
 	return 0;
 }
@@ -22,15 +22,17 @@
  *
  * - skO for names related to objects
  * - skE for names related to environments
+ * - skM for names related to memory management
+ * - skC for names related to compiled code
+ * - skV for names related to values (objects on the stack)
  */
 
 #include <stdio.h>
+#include <stddef.h>
 #include <setjmp.h>
 
 #define SK_O_TAIL
 
-#define SYMBOL_MAX_LENGTH 256
-
 #define FATAL(...) do {                                                      \
 	fprintf (stderr, __VA_ARGS__);                                       \
 	exit(EXIT_FAILURE);                                                  \
@@ -38,13 +40,28 @@
 
 typedef struct symbol   symbol;
 typedef struct skO      skO;
+typedef struct skV      skV;
 typedef struct skE      skE;
 typedef struct context  context;
 typedef struct reserved reserved;
+typedef struct frame_slot frame_slot;
+typedef struct skC_ins  skC_ins;
+typedef struct skC_code skC_code;
+typedef struct sk_output sk_output;
+typedef struct sk_input  sk_input;
+typedef struct sk_profile_record sk_profile_record;
+typedef struct sk_memo   sk_memo;
+typedef struct sk_memo_entry sk_memo_entry;
 
 struct symbol {
-	char   name[SYMBOL_MAX_LENGTH];
-	symbol *next;
+	char     *name;   /* 0 terminated                  */
+	size_t   length;  /* not counting the terminator   */
+	unsigned hash;
+	unsigned defs;    /* live non-native definitions   */
+	unsigned version; /* bumped when definitions of this symbol change */
+	#ifdef SK_PROFILE
+	sk_profile_record *profile; /* figures of the profiler, or NULL */
+	#endif
 };
 
 typedef enum {
@@ -53,48 +70,221 @@ typedef enum {
 	SKO_CHARACTER,
 	SKO_QSYMBOL,
 	SKO_SYMBOL,
-	SKO_LIST
+	SKO_LIST,
+	SKO_STRING,
+	SKO_INTEGER
 } skO_t;
 
+#define SKO_TAGS (SKO_INTEGER + 1)
+
+/*
+ * Only lists and strings have the fields that follow `data': scalar objects
+ * are allocated without them (see `object_alloc').
+ */
 struct skO {
-	skO   *next;
+	skO      *next;
+	skO_t    tag;
+	union {
+		double    number;
+		long long integer;
+		int       boolean;
+		char      character;
+		symbol    *sym;
+		skO       *list;
+		char      *string; /* not 0 terminated, NULL when empty      */
+	} data;
+	size_t   length;  /* lists: number of elements, strings: bytes */
+	skO      *last;   /* lists: last element, NULL when empty     */
+	unsigned long hash; /* lists: `skO_hash', 0 until computed    */
+};
+
+/*
+ * The stack is an array of values rather than a chain of objects. Scalars
+ * (numbers, booleans, characters and symbols) are stored in the value
+ * itself, so that pushing and popping them does not allocate anything; only
+ * lists and strings are referenced as objects.
+ */
+struct skV {
 	skO_t tag;
 	union {
-		double number;
-		int    boolean;
-		char   character;
-		symbol *sym;
-		skO    *list;
+		double    number;
+		long long integer;
+		int       boolean;
+		char      character;
+		symbol    *sym;
+		skO       *obj;   /* SKO_LIST and SKO_STRING */
 	} data;
 };
 
+#define SKV_BOXED(tag) ((tag) == SKO_LIST || (tag) == SKO_STRING)
+
+/*
+ * Record that the value at index `d' of the stack was popped or replaced.
+ * `low' keeps the lowest such index since a memoized call set it to the
+ * depth of the stack, to tell whether the operation took more objects than
+ * its declared arity. When `low' is 0, nothing is recorded.
+ */
+#define SKE_TOUCH(env, d) do {                                                \
+		if ((d) < (env)->low)                                                 \
+			(env)->low = (d);                                                 \
+	} while (0)
+
+/* Environment flags. */
+#define SKE_NO_COMPILE     1 /* do not compile operation bodies              */
+#define SKE_SHIRKA_PRELUDE 2 /* Shirka versions of native prelude operations */
+#define SKE_LINE_BUFFERED  4 /* flush the output at each new line           */
+
 struct skE {
-	skO     *stack;
-	context *scope;
+	skV     *stack;
+	size_t  depth;    /* number of values on the stack */
+	size_t  capacity; /* number of values `stack' can hold */
+	size_t  low;      /* lowest depth touched, see `SKE_TOUCH' */
+	context   *scope;
+	sk_output *out;   /* buffered standard output, set by `skE_init' */
+	sk_input  *in;    /* buffered standard input, set by `skE_init'  */
+	int       flags;
 	jmp_buf jmp;
 };
 
 typedef skO *(skE_natOp)(skE*);
 
-struct context {
-	context  *parent;
-	reserved *first_def;
-};
-
 struct reserved {
 	reserved *next;
 	symbol   *sym;
 	enum {
 		KIND_OBJECT,
 		KIND_OPERATION,
-		KIND_NATIVE
+		KIND_NATIVE,
+		KIND_MEMO       /* memoized operation, see `memo.c' */
 	} kind;
 	union {
 		skO       *obj;
 		skE_natOp *native;
+		sk_memo   *memo;
 	} data;
+	skC_code *code; /* compiled body of an operation, or NULL */
+};
+
+/*
+ * Local reserves of a compiled operation (`-> x ... <- x') are stored in
+ * slots allocated along with the context of each call, rather than in
+ * nodes chained to `first_def'. A slot holds the oldest object reserved
+ * under its name in the context; more recent ones overflow to `first_def'.
+ */
+struct frame_slot {
+	reserved def;      /* `def.data.obj' is NULL when the slot is empty */
+	size_t   overflow; /* definitions of `def.sym' in `first_def'      */
+};
+
+struct context {
+	context    *parent;
+	reserved   *first_def;
+	skC_code   *frame;  /* code the slots were laid out for, or NULL */
+	size_t     nslots;
+	frame_slot slots[];
+};
+
+typedef enum {
+	SKC_PUSH,    /* push a copy of `obj'                  */
+	SKC_CALL,    /* look `sym' up and execute it          */
+	SKC_TAIL,    /* same as SKC_CALL, in tail position    */
+	SKC_RESERVE, /* `:sym $->'                            */
+	SKC_RESTORE, /* `:sym $<-'                            */
+	SKC_DEFINE,  /* `:sym $=>'                            */
+	SKC_DUP,     /* `-> x x <- x'                         */
+	SKC_SWAP,    /* `-> x -> y <- x <- y'                 */
+	SKC_DROP,    /* `-> x' at the end of a body           */
+	SKC_OPERAND, /* integer literal, then an arithmetic call */
+	SKC_UNLESS,  /* `not [...] !?'                        */
+	SKC_CONST,   /* push `value', computed when compiling  */
+	SKC_END
+} skC_op;
+
+struct skC_ins {
+	skC_op   op;
+	symbol   *sym;
+	skO      *obj;     /* token the instruction was compiled from */
+	reserved *cache;   /* last resolution of `sym'                */
+	unsigned version;  /* `sym->version' when `cache' was filled  */
+	size_t   slot;     /* SKC_RESERVE, SKC_RESTORE: frame slot    */
+	size_t   span;     /* number of instructions performed        */
+	skO      *value;   /* SKC_CONST: result of the folded code    */
+};
+
+struct skC_code {
+	size_t  nslots;
+	symbol  **locals;  /* name of each frame slot */
+	skC_op  idiom;     /* SKC_DUP, SKC_SWAP or SKC_DROP if the whole
+	                      body is that idiom, SKC_END otherwise */
+	size_t  length;
+	skC_ins ins[];
 };
 
+/*////////////////////////////////////////////////////////////////////////////
+//                                  MEMORY                                  //
+////////////////////////////////////////////////////////////////////////////*/
+
+typedef struct {
+	unsigned long allocs; /* blocks handed out since startup     */
+	unsigned long frees;  /* blocks given back since startup     */
+	unsigned long live;   /* blocks currently in use             */
+	unsigned long peak;   /* highest value reached by `live'     */
+	unsigned long slabs;  /* slabs requested from the system     */
+} skM_stats;
+
+extern skM_stats skM_counters;
+
+/*
+ * Allocate and release fixed-size blocks (objects, contexts, reserved
+ * nodes...) from the slab pools. `size' must be the same in both calls.
+ */
+void *skM_alloc   (size_t size);
+void skM_free     (void *ptr, size_t size);
+
+/* Give all slabs back to the system. Every pooled block becomes invalid. */
+void skM_release  (void);
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                STATISTICS                                //
+////////////////////////////////////////////////////////////////////////////*/
+
+/*
+ * Counts of what the runtime does since startup, reported by `--stats' and
+ * the `stats' intrinsic along with the memory counters.
+ */
+typedef struct {
+	unsigned long allocs[SKO_TAGS]; /* objects allocated, by tag           */
+	unsigned long frees[SKO_TAGS];  /* objects released, by tag            */
+	unsigned long live;             /* objects currently allocated         */
+	unsigned long peak_live;        /* highest value reached by `live'     */
+	unsigned long instructions;     /* instructions and tokens executed    */
+	unsigned long clones;           /* calls to `skO_clone'                */
+	unsigned long cloned;           /* objects copied by these calls       */
+	unsigned long lookups;          /* symbols searched through the scopes */
+	unsigned long lookup_nodes;     /* definitions examined by the search  */
+	unsigned long scope_pushes;
+	unsigned long scope_pops;
+	unsigned long peak_depth;       /* deepest stack                       */
+	unsigned long memo_hits;        /* calls answered by a memo cache      */
+	unsigned long memo_misses;
+	unsigned long memo_evictions;
+} sk_stats;
+
+extern sk_stats sk_counters;
+
+typedef struct {
+	char          name[32];
+	unsigned long value;
+} sk_stat;
+
+#define SK_STATS_MAX 48
+
+/*
+ * Fill `stats' with the name and value of every counter, memory counters
+ * included. Return the number of entries, at most `SK_STATS_MAX'.
+ */
+size_t sk_stats_collect (sk_stat *stats);
+
 /*////////////////////////////////////////////////////////////////////////////
 //                                 OBJECTS                                  //
 ////////////////////////////////////////////////////////////////////////////*/
@@ -103,11 +293,26 @@ struct reserved {
  * Allocate memory for objects and initialize them.
  */
 skO *skO_number_new        (double d);
+skO *skO_integer_new       (long long i);
 skO *skO_boolean_new       (int b);
 skO *skO_character_new     (char c);
 skO *skO_quoted_symbol_new (char *a);
 skO *skO_symbol_new        (char *a);
+skO *skO_symbol_new_n      (char *a, size_t n);
 skO *skO_list_new          (void);
+skO *skO_string_new        (const char *bytes, size_t length);
+
+/*
+ * Find or create the unique symbol named by the `length' first characters of
+ * `name'. Symbols are never released.
+ */
+symbol *sk_symbol_intern (const char *name, size_t length);
+
+/*
+ * Bump the version of every symbol, invalidating all cached resolutions.
+ * Used when a scope chain is abandoned without being popped.
+ */
+void sk_symbol_invalidate (void);
 
 /*
  * Parse a string.
@@ -115,10 +320,24 @@ skO *skO_list_new          (void);
 skO *skO_parse (char **next, jmp_buf jmp, char *delim);
 
 /*
- * Parse a file.
+ * Parse a file, or the standard input stream if `path' is "-".
  */
 skO *skO_loadParse (char *path);
 
+/*
+ * Contents of a file, mapped in memory or read into a buffer. The text is
+ * always followed by a 0.
+ */
+typedef struct {
+	char   *text;
+	size_t length;
+	size_t mapped; /* length of the mapping, or 0 if `text' was allocated */
+} sk_source;
+
+/* Open a file ("-" for the standard input stream). Return 0 on failure. */
+int  sk_source_open  (sk_source *src, char *path);
+void sk_source_close (sk_source *src);
+
 /*
  * Perform a deep copy of `obj'. Object referenced in the `next' field of the
  * struct is NOT copied but set to `NULL' in the copy.
@@ -132,18 +351,107 @@ skO *skO_clone (skO *obj);
  */
 void skO_free (skO *obj);
 
+/*
+ * Compare `l' and `r' like the `=' intrinsic: by structure, numbers by value
+ * whatever their representation, strings like lists of characters.
+ */
+int skO_eql (skO *l, skO *r);
+
+/*
+ * Structural hash of `obj', consistent with `skO_eql': equal objects have
+ * equal hashes. The hash of a list is kept in the list until the list is
+ * changed by one of the `sk_list_' functions.
+ */
+unsigned long skO_hash (skO *obj);
+
 /*
  * Check if `obj' is tagged with `type'.
  * Halt execution of the program if the check fails.
  */
 void skO_checkType (skO *obj, skO_t type);
 
+/*
+ * Check if `obj' is a list, for operations that work on its elements.
+ * Strings are accepted too: they are unpacked in place into lists of
+ * characters (see `sk_string_unpack').
+ */
+void skO_checkList (skO *obj);
+
+/*
+ * Numbers are represented either as integers (SKO_INTEGER) when they are
+ * exact and fit in a `long long', or as floating point numbers (SKO_NUMBER).
+ * Both are of type `Number' for Shirka programs, and SKO_NUMBER type checks
+ * accept integers.
+ */
+
+/* Value of a number of either representation, as a floating point number. */
+double sk_number_double (skO *obj);
+
+/*
+ * Value corresponding to `obj'. Lists and strings are referenced, not
+ * copied.
+ */
+skV skV_of (skO *obj);
+
+/*
+ * Object corresponding to a value: the referenced object for lists and
+ * strings, a new one for scalars.
+ */
+skO *skV_box (skV v);
+
+/* Same as `skO_checkType', for values. */
+void skV_checkType (skV *v, skO_t type);
+
+/* Same as `sk_number_double', for values. */
+double skV_double (skV v);
+
+/* Same as `skO_hash', for values. */
+unsigned long skV_hash (skV v);
+
+/*
+ * Same as `skO_eql', for values. When `strict' is set, objects must also
+ * have the same representation: `1' and `1.0', or a string and the list of
+ * its characters, are different, and numbers are compared bit for bit.
+ */
+int skV_eql (skV l, skV r, int strict);
+
+/*
+ * Strings are packed arrays of bytes. They behave like lists of characters,
+ * which they are turned into as soon as they are used as such.
+ */
+
+/* Turn the string `obj' into the equivalent list of characters. */
+void sk_string_unpack (skO *obj);
+
+/*
+ * Return a 0 terminated copy of the characters of `obj' (a string or a list
+ * of characters), allocated with `malloc'.
+ */
+char *sk_string_cstring (skO *obj);
+
+/*
+ * Lists cache their length and last element. Their contents must only be
+ * changed through the following operations, which keep both up to date.
+ */
+
 /*
  * Insert `obj' after the last member of `list'. Can also be used to join two
- * lists.
+ * lists, `obj' being the first node of the chain to append.
  */
 void sk_list_append (skO *list, skO *obj);
 
+/* Insert `obj' before the first member of `list'. */
+void sk_list_cons   (skO *list, skO *obj);
+
+/* Detach and return the first member of `list', or NULL if it is empty. */
+skO *sk_list_uncons (skO *list);
+
+/* Replace the contents of `list' by the chain starting at `head'. */
+void sk_list_set    (skO *list, skO *head);
+
+/* Reverse the order of the members of `list', in place. */
+void sk_list_reverse (skO *list);
+
 /*////////////////////////////////////////////////////////////////////////////
 //                               ENVIRONMENTS                               //
 ////////////////////////////////////////////////////////////////////////////*/
@@ -161,16 +469,164 @@ void skE_defObject    (skE *env, skO *sym, skO *obj);
 void skE_defOperation (skE *env, skO *sym, skO *obj);
 void skE_undef        (skE *env, skO *sym);
 
+/*
+ * Memoize the operation `sym' of the current scope, which takes `arity'
+ * objects from the stack (see `memo.c').
+ */
+void skE_memoize      (skE *env, skO *sym, size_t arity);
+
 /* Go in and out of scope. */
 void skE_scopePush    (skE *env);
 void skE_scopePop     (skE *env);
 
-/* Push and pop objects to/from the stack. */
+/*
+ * Push and pop objects to/from the stack. Scalars are unboxed when pushed
+ * (the object is released) and boxed again when popped.
+ */
 void skE_stackPush    (skE *env, skO *obj);
 skO *skE_stackPop     (skE *env);
 
+/* Push a copy of `obj', without allocating anything for scalars. */
+void skE_stackPushCopy  (skE *env, skO *obj);
+
+/* Push and pop values, without boxing scalars. */
+void skE_stackPushValue (skE *env, skV v);
+skV  skE_stackPopValue  (skE *env);
+
 /* Execute objects in an environment. */
 void skE_call         (skE *env, skO *sym);
 void skE_execList     (skE *env, skO *list, int scoping);
 
+/*
+ * Return the native operation `sym' resolves to in `env', or NULL if it is
+ * not defined as a native operation.
+ */
+skE_natOp *skE_lookupNative (skE *env, symbol *sym);
+
+/*////////////////////////////////////////////////////////////////////////////
+//                             INPUT AND OUTPUT                             //
+////////////////////////////////////////////////////////////////////////////*/
+
+/*
+ * Output buffers, written to `file' when full or flushed. Buffers still in
+ * use are flushed at exit.
+ */
+sk_output *sk_output_new   (FILE *file, int line_buffered);
+void       sk_output_free  (sk_output *out);
+void       sk_output_flush (sk_output *out);
+void       sk_output_write (sk_output *out, const char *bytes, size_t length);
+void       sk_output_char  (sk_output *out, char c);
+
+/*
+ * Input buffers, reading from `file'. `tie', if not NULL, is flushed before
+ * blocking for more input.
+ */
+sk_input *sk_input_new  (FILE *file, sk_output *tie);
+void      sk_input_free (sk_input *in);
+
+/* Read a byte. Return EOF at the end of input. */
+int       sk_input_getc (sk_input *in);
+
+/*
+ * Read a line and return it as a string, without its new line character.
+ * Return NULL at the end of input.
+ */
+skO      *sk_input_line (sk_input *in);
+
+/*
+ * Read `max' bytes, or less at the end of input, and return them as a
+ * string. Return NULL if `max' is not 0 and the input has already ended.
+ */
+skO      *sk_input_read (sk_input *in, size_t max);
+
+/*////////////////////////////////////////////////////////////////////////////
+//                               MEMOIZATION                                //
+////////////////////////////////////////////////////////////////////////////*/
+
+/*
+ * Memo caches of operations taking `arity' objects. The cache takes
+ * ownership of the body of the operation and of its compiled code, if any.
+ */
+sk_memo  *sk_memo_new   (skO *body, skC_code *code, size_t arity);
+void     sk_memo_free   (sk_memo *memo);
+skO      *sk_memo_body  (sk_memo *memo);
+skC_code *sk_memo_code  (sk_memo *memo);
+
+/*
+ * If the arguments on top of the stack of `env' are in the cache, replace
+ * them with the cached results and return 1. Return 0 otherwise.
+ */
+int      sk_memo_lookup (sk_memo *memo, skE *env);
+
+/*
+ * Record the arguments on top of the stack before running the operation,
+ * then the results once it has run. An entry whose operation failed is
+ * released with `sk_memo_discard' instead.
+ */
+sk_memo_entry *sk_memo_begin   (sk_memo *memo, skE *env);
+void           sk_memo_end     (sk_memo *memo, sk_memo_entry *entry, skE *env);
+void           sk_memo_discard (sk_memo *memo, sk_memo_entry *entry);
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                 PROFILER                                 //
+////////////////////////////////////////////////////////////////////////////*/
+
+#ifdef SK_PROFILE
+/* Start profiling, and register the report to be printed at exit. */
+void   sk_profile_init   (void);
+
+/* Record the start and the end of a call of `sym'. */
+void   sk_profile_enter  (symbol *sym);
+void   sk_profile_leave  (void);
+
+/*
+ * Number of calls in progress, and end of those started since it was
+ * `depth', when they are abandoned by a `longjmp'.
+ */
+size_t sk_profile_depth  (void);
+void   sk_profile_unwind (size_t depth);
+#endif
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                  IMAGES                                  //
+////////////////////////////////////////////////////////////////////////////*/
+
+/*
+ * Save the definitions of the root scope of `env' (intrinsics excepted) to
+ * the image file `path', recording the file `source' they come from.
+ * Return 0 on failure.
+ */
+int skE_saveImage (skE *env, char *path, char *source);
+
+/*
+ * Define the contents of an image in the current scope of `env'. Return 0,
+ * without defining anything, if the image is missing, damaged or older than
+ * `source'.
+ */
+int skE_loadImage (skE *env, char *path, char *source);
+
+/*////////////////////////////////////////////////////////////////////////////
+//                                 COMPILER                                 //
+////////////////////////////////////////////////////////////////////////////*/
+
+/* Symbols of the reserving intrinsics, set by `skC_init'. */
+extern symbol *sk_sym_reserve;
+extern symbol *sk_sym_restore;
+extern symbol *sk_sym_define;
+
+void skC_init         (void);
+
+/*
+ * Compile the body of an operation, defined in `env'. The returned code
+ * refers to the tokens of `body', which must not be released before the
+ * code. Constants are not folded when `env' is NULL, for bodies compiled
+ * for a single run of a combinator, where folding would cost more than it
+ * saves.
+ */
+skC_code *skC_compile (skE *env, skO *body);
+void skC_free         (skC_code *code);
+
+/* Print compiled code, defined as `name', on `f'. */
+void skC_dump         (FILE *f, symbol *name, skC_code *code);
+
 #endif
@@ -0,0 +1,165 @@
+#!/bin/sh
+# Copyright (c) 2013, Jeremy Pinat.
+#
+# Test suite.
+#
+# Run the test files of the test directory, which print the tests that fail
+# and nothing else, with the file of the same name ending in `.txt', if any,
+# on their standard input. Then run the checks that need a process of their
+# own: programs read from the standard input, command line options, and type
+# errors, which end the interpreter instead of raising an error `try' can
+# catch. Print each failure, and exit with a non-zero status if there was any.
+#
+# Run from the root of the repository, so that test files find their modules.
+#
+# Usage: test/run.sh [SHIRKA]
+
+SHIRKA=${1:-./shirka}
+TMP=${TMPDIR:-/tmp}/shirka-test-$$
+TEST=$(dirname "$0")
+FAILED=0
+
+trap 'rm -rf "$TMP"' EXIT INT TERM
+mkdir -p "$TMP"
+
+# check NAME EXPECTED COMMAND
+#
+# Run the shell command COMMAND, which must succeed, and compare its standard
+# output to EXPECTED.
+check () {
+	RESULT=$(eval "$3" 2> /dev/null)
+	STATUS=$?
+	if [ $STATUS -ne 0 ]; then
+		RESULT="$RESULT
+(exit status $STATUS)"
+	fi
+	if [ "$RESULT" != "$2" ]; then
+		printf '%s failed:\n  Expected: %s\n    Result: %s\n\n' \
+			"$1" "$2" "$RESULT"
+		FAILED=1
+	fi
+}
+
+# check_error NAME MESSAGE PROGRAM
+#
+# Run the Shirka program PROGRAM, which must fail and print MESSAGE on the
+# standard error stream.
+check_error () {
+	if echo "$3" | "$SHIRKA" - > /dev/null 2> "$TMP/stderr" \
+		|| ! grep -qF "$2" "$TMP/stderr"; then
+		printf '%s failed:\n  Expected: %s\n    Result: %s\n\n' \
+			"$1" "$2" "$(cat "$TMP/stderr")"
+		FAILED=1
+	fi
+}
+
+HEADER='-- Running tests... (Only failed tests are displayed)'
+
+for FILE in "$TEST"/*.shk; do
+	INPUT=${FILE%.shk}.txt
+	[ -f "$INPUT" ] || INPUT=/dev/null
+	check "$FILE" "$HEADER" "\"\$SHIRKA\" \"$FILE\" < \"$INPUT\""
+done
+
+check '-' -1234567890123456789 \
+	"echo '-1234567890123456789 print' | \"\$SHIRKA\" -"
+
+# Sources longer than the first read buffer, and files that cannot be mapped
+# because their size is a multiple of the page size, are read in chunks.
+awk 'BEGIN { for (i = 0; i < 20000; i++) print "1 <<"; print "42 print" }' \
+	> "$TMP/long.shk"
+check 'long source' 42 "\"\$SHIRKA\" \"$TMP/long.shk\""
+check 'long source on -' 42 "\"\$SHIRKA\" - < \"$TMP/long.shk\""
+
+PAGE=$(getconf PAGESIZE)
+{ printf '42 print --'; head -c $((PAGE - 11)) /dev/zero | tr '\0' x; } \
+	> "$TMP/page.shk"
+check 'page sized source' 42 "\"\$SHIRKA\" \"$TMP/page.shk\""
+
+check 'missing source' "INTERPRETER ERROR! Could not open file $TMP/none.shk.
+failed" "\"\$SHIRKA\" \"$TMP/none.shk\" 2>&1 || echo failed"
+
+echo 'read-all print read-all print' > "$TMP/read-all.shk"
+check 'read-all' 'a
+b$eof' "printf 'a\\nb' | \"\$SHIRKA\" \"$TMP/read-all.shk\""
+
+check 'examples at end of input' 'Please enter 11 numbers:' \
+	"\"\$SHIRKA\" examples/tpk_algorithm.shk < /dev/null"
+
+# Counters are printed on the standard error stream at exit.
+echo '(=> f) [ 1 + ] :f 1 memoize 1 f << 1 f << 2 f <<' > "$TMP/stats.shk"
+check '--stats' 'memo/hits 1
+memo/misses 2' "\"\$SHIRKA\" --stats \"$TMP/stats.shk\" 2>&1 \\
+	| awk '/^memo\/(hits|misses) / { print \$1, \$2 }'"
+
+# Output is buffered. Errors are written at once on the standard error stream,
+# which shows what was written before them.
+FAIL='(try) [ [] uncons ] <<'
+ERROR='PANIC! Tried to uncons an empty list.'
+echo "\"a\" print $FAIL \"b\" print" > "$TMP/buffered.shk"
+echo "\"a\" print flush $FAIL \"b\" print" > "$TMP/flush.shk"
+echo "\"a\\n\" print $FAIL \"b\" print" > "$TMP/line.shk"
+echo "\"a\" print read-line << $FAIL \"b\" print" > "$TMP/read.shk"
+
+check 'buffered output' "$ERROR
+ab" "\"\$SHIRKA\" \"$TMP/buffered.shk\" 2>&1"
+check 'flush' "a$ERROR
+b" "\"\$SHIRKA\" \"$TMP/flush.shk\" 2>&1"
+check 'line' "$ERROR
+a
+b" "\"\$SHIRKA\" \"$TMP/line.shk\" 2>&1"
+check '--line-buffered' "a
+$ERROR
+b" "\"\$SHIRKA\" --line-buffered \"$TMP/line.shk\" 2>&1"
+check 'flush before input' "a$ERROR
+b" "echo x | \"\$SHIRKA\" \"$TMP/read.shk\" 2>&1"
+
+# The prelude image is used only when it is complete and was built from the
+# prelude as it is now. This prelude tells whether it ran.
+mkdir -p "$TMP/lib"
+cat > "$TMP/lib/prelude.shk" <<'EOF'
+(=> probe) [ 42 ]
+[ 1.5 :a "str" 'c TRUE [ x ] ] -> probe/list
+"prelude " print
+EOF
+echo 'probe print' > "$TMP/probe.shk"
+PROBE="SHIRKA_LIB=\"$TMP/lib\" \"\$SHIRKA\" \"$TMP/probe.shk\""
+
+check 'no image' 'prelude 42' "$PROBE"
+SHIRKA_LIB="$TMP/lib" "$SHIRKA" --build-image > /dev/null
+check 'image' 42 "$PROBE"
+
+cp "$TMP/lib/prelude.img" "$TMP/prelude.img"
+SIZE=$(wc -c < "$TMP/prelude.img")
+n=0
+while [ $n -lt "$SIZE" ]; do
+	head -c $n "$TMP/prelude.img" > "$TMP/lib/prelude.img"
+	check "image truncated to $n bytes" 'prelude 42' "$PROBE"
+	n=$((n + 1))
+done
+
+# Same size and modification time, different contents.
+cp "$TMP/prelude.img" "$TMP/lib/prelude.img"
+touch -r "$TMP/lib/prelude.shk" "$TMP/stamp"
+sed 's/42/43/' "$TMP/lib/prelude.shk" > "$TMP/prelude.shk"
+cp "$TMP/prelude.shk" "$TMP/lib/prelude.shk"
+touch -r "$TMP/stamp" "$TMP/lib/prelude.shk"
+check 'stale image' 'prelude 43' "$PROBE"
+
+for OP in + - '*' / ^ % '>' '<' '>=' '<='; do
+	for X in :a ':a unquote' "'a" '[a]' TRUE; do
+		check_error "1 $X $OP" "Expected \`Number'" "1 $X $OP"
+		check_error "$X 1 $OP" "Expected \`Number'" "$X 1 $OP"
+	done
+done
+
+for X in :a ':a unquote' "'a" '[a]' TRUE; do
+	check_error "$X abs" "Expected \`Number'" "$X abs"
+done
+
+for X in 1 "'a" '[a]' '"ab"' TRUE; do
+	check_error "$X quote" "Expected \`Symbol'" "$X quote"
+	check_error "$X unquote" "Expected \`QuotedSymbol'" "$X unquote"
+done
+
+exit $FAILED